@@ -22,12 +22,17 @@
 #include <time.h>
 #include "message.h"
 
+/**************** global constants ****************/
+// the longest run one RLE triple stands for; the server's RLE_MAX_RUN
+#define RLE_MAX_RUN ('~' - ' ')
+
 /**************** global types ****************/
 typedef struct data {
   // size of board, initialized to initial window size
   int NROWS;
   int NCOLS;
   char player; //if non-zero, prepresents player's letter inbetween display frames
+  int seq; // sequence number of the last DELTA frame applied, 0 if none
 } data_t;
 
 // internal function prototypes
@@ -44,6 +49,9 @@ static bool handleOK(const char* message);
 static bool handleGRID(const char* message);
 static bool handleGOLD(const char* message);
 static void handleDISPLAY(const char* message);
+static void handleDELTA(const addr_t from, const char* message);
+static void handleDISPLAYRLE(const addr_t from, const char* message);
+static char* rle_decode(const char* payload);
 
 // game helper function
 static data_t* data_new();
@@ -119,6 +127,10 @@ int main(int argc, char *argv[])
       // failed to initialize player name
     }
   }
+  // ask for DELTA frames instead of full DISPLAY frames,
+  // and for full frames (keyframes) to be run-length encoded
+  message_send(server, "DELTA");
+  message_send(server, "RLE");
 
   // Loop, waiting for input or for messages; provide callback functions.
   // We use the 'arg' parameter to carry a pointer to 'server'.
@@ -218,6 +230,16 @@ handleMessage(void* arg, const addr_t from, const char* message)
 
     return false;
 
+  } else if (strncmp(message, "DISPLAY RLE\n", strlen("DISPLAY RLE\n")) == 0) {
+    handleDISPLAYRLE(from, message);
+
+    return false;
+
+  } else if (strncmp(message, "DELTA ", strlen("DELTA ")) == 0) {
+    handleDELTA(from, message);
+
+    return false;
+
   } else if (strncmp(message, "QUIT ", strlen("QUIT ")) == 0) {
     // close curses
     endwin(); // CURSES
@@ -363,6 +385,136 @@ handleDISPLAY(const char* message)
   display_map(display);
 }
 
+/**************** handleDELTA ****************/
+/* takes a char* as an argument, of the DELTA message type:                */
+/*   DELTA seq base\n followed by lines of "row col text\n"                */
+/* each line overwrites the map starting at (row, col) with text.          */
+/* base 0 is a keyframe, drawn on a blank map; any other base must be the  */
+/* last frame we applied, or a frame was lost and we ask for a RESYNC.     */
+/* A keyframe may instead be "DELTA seq 0 RLE\n" and a whole encoded map.  */
+static void
+handleDELTA(const addr_t from, const char* message)
+{
+  int seq;
+  int base;
+  int offset = 0;
+  if (sscanf(message, "DELTA %d %d\n%n", &seq, &base, &offset) != 2 || offset == 0) {
+    fprintf(stderr, "ERROR: Malformed DELTA message '%s'\n", message);
+    return;
+  }
+  if (base != 0 && base != data->seq) {
+    // missed a frame; the server answers with a keyframe
+    message_send(from, "RESYNC");
+    return;
+  }
+  if (base == 0 && strncmp(message + offset, "RLE\n", strlen("RLE\n")) == 0) {
+    // the payload starts right after the header line, perhaps with spaces
+    char* display = rle_decode(strchr(message, '\n') + 1);
+    if (display == NULL) {
+      fprintf(stderr, "ERROR: Malformed RLE keyframe\n");
+      message_send(from, "RESYNC");
+      return;
+    }
+    display_map(display);
+    free(display);
+    data->seq = seq;
+    return;
+  }
+  if (base == 0) {
+    init_map();
+  }
+
+  // apply each run of changed cells
+  const char* line = message + offset;
+  while (*line != '\0') {
+    int row;
+    int col;
+    int textStart = 0;
+    int lineLength = strcspn(line, "\n");
+    // text follows a single space, and may itself start with spaces
+    if (sscanf(line, "%d %d%n", &row, &col, &textStart) == 2 && textStart < lineLength
+        && line[textStart++] == ' ' && row >= 0 && row + 1 < data->NROWS && col >= 0) {
+      int textLength = lineLength - textStart;
+      if (col + textLength > data->NCOLS) {
+        textLength = data->NCOLS - col;
+      }
+      if (textLength > 0) {
+        mvaddnstr(row+1, col, line + textStart, textLength); // CURSES, +1 account for info line
+      }
+    }
+    line += lineLength;
+    if (*line == '\n') {
+      line++;
+    }
+  }
+  refresh(); // CURSES
+  data->seq = seq;
+}
+
+/**************** handleDISPLAYRLE ****************/
+/* takes a char* as an argument, of the DISPLAY RLE message type:          */
+/* "DISPLAY RLE\n" followed by a run-length encoded map (see rle_decode).  */
+/* decodes the map and displays it as handleDISPLAY does; if it is        */
+/* malformed, drops it and asks for a RESYNC.                              */
+static void
+handleDISPLAYRLE(const addr_t from, const char* message)
+{
+  char* display = rle_decode(message + strlen("DISPLAY RLE\n"));
+  if (display == NULL) {
+    fprintf(stderr, "ERROR: Malformed DISPLAY RLE message\n");
+    message_send(from, "RESYNC");
+    return;
+  }
+  display_map(display);
+  free(display);
+}
+
+/**************** rle_decode ****************/
+/* decodes a run-length encoded map: '~', a count character and a          */
+/* character stand for (count - ' ') copies of that character; anything    */
+/* else stands for itself. Returns a new string, which the caller frees,   */
+/* or NULL if the payload is malformed (a count outside 1..RLE_MAX_RUN,    */
+/* or a run cut short) or out of memory.                                   */
+static char*
+rle_decode(const char* payload)
+{
+  // first pass: the length of the decoded map
+  size_t length = 0;
+  const char* p = payload;
+  while (*p != '\0') {
+    if (*p == '~') {
+      // the count is a byte, so read it unsigned: a high byte is no count
+      int count = (unsigned char) p[1] - ' ';
+      if (count < 1 || count > RLE_MAX_RUN || p[2] == '\0') {
+        return NULL;
+      }
+      length += count;
+      p += 3;
+    } else {
+      length++;
+      p++;
+    }
+  }
+
+  char* display = malloc(length + 1);
+  if (display == NULL) {
+    return NULL;
+  }
+  size_t len = 0;
+  for (p = payload; *p != '\0'; ) {
+    if (*p == '~') {
+      int count = (unsigned char) p[1] - ' ';
+      memset(display + len, p[2], count);
+      len += count;
+      p += 3;
+    } else {
+      display[len++] = *p++;
+    }
+  }
+  display[len] = '\0';
+  return display;
+}
+
 /* ************ initialize_curses *********************** */
 /* initialize curses // CURSES everywhere in this function */
 static void
@@ -492,6 +644,7 @@ data_new()
   data->NROWS = -1;
   data->NCOLS = -1;
   data->player = 0;
+  data->seq = 0;
 
   return data;
 }
@@ -13,13 +13,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include "mem.h"
 
 /**************** file-local global variables ****************/
-// track malloc and free across *all* calls within this program.
-static int nmalloc = 0;         // number of successful malloc calls
-static int nfree = 0;           // number of free calls
-static int nfreenull = 0;       // number of free(NULL) calls
+// track malloc and free across *all* calls within this program,
+// in every thread.
+static atomic_int nmalloc = 0;  // number of successful malloc calls
+static atomic_int nfree = 0;    // number of free calls
+static atomic_int nfreenull = 0; // number of free(NULL) calls
 
 
 /**************** mem_assert ****************/
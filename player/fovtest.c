@@ -0,0 +1,83 @@
+/*
+ * fovtest.c - conformance test for grid_fieldOfView
+ *
+ * For every map named on the command line, and every room and passage
+ * cell in it, checks that grid_fieldOfView marks exactly the cells that
+ * grid_isVisible says are visible. Prints one line per map and exits
+ * nonzero if any map disagrees or cannot be loaded.
+ *
+ * usage: ./fovtest map...
+ * 
+ * CS50 Nuggets Final Project
+ * Team 17 - CecsC
+ */
+
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "grid.h"
+#include "gridcell.h"
+
+static int checkMap(char* pathName);
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s map...\n", argv[0]);
+        return 1;
+    }
+
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        int mismatches = checkMap(argv[i]);
+        printf("%s: %s", argv[i], mismatches == 0 ? "ok\n" : "MISMATCH");
+        if (mismatches != 0) {
+            printf(" (%d cells)\n", mismatches);
+            failed++;
+        }
+    }
+
+    printf("%d of %d maps match\n", argc - 1 - failed, argc - 1);
+    return failed == 0 ? 0 : 1;
+}
+
+/* compare the two visibility functions from every room and passage cell
+ * of one map; return the number of cells where they disagree, or 1 if
+ * the map cannot be loaded
+ */
+static int checkMap(char* pathName)
+{
+    // no grid_buildVisibility here, so both sides really do the work
+    grid_t* grid = grid_new();
+    if (!grid_load(grid, pathName)) {
+        grid_delete(grid);
+        return 1;
+    }
+
+    int totalCells = grid_get_NR(grid) * grid_get_NC(grid);
+    int NC = grid_get_NC(grid);
+    uint64_t* visible = malloc(sizeof(uint64_t) * ((totalCells + 63) / 64));
+
+    int mismatches = 0;
+    for (int from = 0; from < totalCells; from++) {
+        gridcell_t player = grid_get_gridarray(grid, from);
+        char c = gridcell_getC(player);
+        if (c != '.' && c != '#') {
+            continue;
+        }
+
+        grid_fieldOfView(grid, from % NC, from / NC, visible);
+        for (int to = 0; to < totalCells; to++) {
+            bool fov = (visible[to / 64] >> (to % 64)) & 1;
+            bool ray = grid_isVisible(grid, player, grid_get_gridarray(grid, to));
+            if (fov != ray) {
+                mismatches++;
+            }
+        }
+    }
+
+    free(visible);
+    grid_delete(grid);
+    return mismatches;
+}
@@ -40,33 +40,106 @@ puts(grid);         // produces the output below
     puts(grid) will loop through gridCell array, if show, then put c, if !show, put blank space
 */
 
+#define _POSIX_C_SOURCE 200809L   // mmap, fstat
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "grid.h"
 #include "file.h"
 #include "mem.h"
 #include "gridcell.h"
+#include "trace.h"
 
 /**************** file-local global variables ****************/
-/* none */
+static const char VisMagic[8] = "NUGVIS1";   // first bytes of a visibility cache file
+static const char MapMagic[8] = "NUGMAP1";   // first bytes of a compiled map file
+
+/* The header of a compiled map file (see grid_save). The sections follow
+ * it in this order, each starting on an 8-byte boundary: terrain (NR*NC
+ * chars), wall bitmap and room bitmap (one bit per cell, 64 cells per
+ * word), room cells (numRoomCells ints), and, if numVisRows > 0, the
+ * visibility table's visRow (NR*NC ints) and rows (numVisRows bitsets).
+ */
+typedef struct mapHeader {
+  char magic[8];                // MapMagic
+  int32_t NR;
+  int32_t NC;
+  int32_t numRoomCells;
+  int32_t numVisRows;           // 0 if there is no visibility table
+  uint64_t size;                // size of the whole file
+} mapHeader_t;
 
 /**************** global types ****************/
 typedef struct grid {
-  gridcell_t** gridarray;       // array of gridcells in the grid
+  gridcells_t cells;            // the arrays below that gridcells view
+  char* chars;                  // terrain character of each cell, fixed once loaded
+  int* gold;                    // gold in each cell; with occupant, the layer over the terrain; start of the one allocation
+  int* occupant;                // id of the player in each cell, -1 if none
+  int* roomCells;               // index of every room cell, in order
+  int numRoomCells;
+  int* freeCells;               // index of every room cell with no gold and no player, in no order
+  int numFreeCells;
+  int* freePos;                 // where each cell is in freeCells, -1 if it isn't
+  bool* room;                   // is each cell in a room?
+  bool* wall;                   // is each cell a wall?
   char* map;
   int NR;                       // number of rows
   int NC;                       // number of columns
+  int* visRow;                  // row of visTable for each cell, -1 if none (NULL if no table)
+  uint64_t* visTable;           // one bitset of visible cells per room or passage cell
+  int visWords;                 // number of words in each bitset
+  int numVisRows;               // number of bitsets in visTable
+  int* fovQueue;                // scratch space for grid_fieldOfView
+  uint64_t* fovExamined;        // scratch space for grid_fieldOfView
+  void* mapping;                // compiled map file the visibility table lives in, or NULL
+  size_t mappingSize;
 } grid_t;
 
+/**************** file-local functions ****************/
+static bool rayIsVisible(grid_t* grid, int startX, int startY, int endX, int endY);
+static uint64_t wallHash(grid_t* grid);
+static bool readVisibility(grid_t* grid, const char* cachePath);
+static void writeVisibility(grid_t* grid, const char* cachePath);
+static bool loadText(grid_t* grid, const char* data, size_t size);
+static bool loadBinary(grid_t* grid, const char* data, size_t size);
+static void allocCells(grid_t* grid, int numRows, int numCols);
+static void findRoomCells(grid_t* grid);
+static void initFreeCells(grid_t* grid);
+static void updateFreeCell(grid_t* grid, int idx);
+static size_t mapLayout(int NR, int NC, int numRoomCells, int numVisRows, size_t offsets[6]);
+
 
 /* create new grid. See 'grid.h' for more info */
 grid_t* grid_new() {
   // Allocate memory for the grid structure
   grid_t* grid = mem_assert(malloc(sizeof(grid_t)), "grid memory error");
+  grid->gold = NULL;
+  grid->occupant = NULL;
+  grid->map = NULL;
+  grid->NR = 0;
+  grid->NC = 0;
+  grid->visRow = NULL;
+  grid->visTable = NULL;
+  grid->visWords = 0;
+  grid->numVisRows = 0;
+  grid->fovQueue = NULL;
+  grid->fovExamined = NULL;
+  grid->roomCells = NULL;
+  grid->numRoomCells = 0;
+  grid->freeCells = NULL;
+  grid->numFreeCells = 0;
+  grid->freePos = NULL;
+  grid->mapping = NULL;
+  grid->mappingSize = 0;
 
   // Return the initialized grid
   return grid;
@@ -92,12 +165,12 @@ int grid_get_NC(grid_t* grid) {
   }
 }
 
-gridcell_t* grid_get_gridarray(grid_t* grid, int idx)
+gridcell_t grid_get_gridarray(grid_t* grid, int idx)
 {
-  if (grid != NULL && idx >= 0) {
-    return grid->gridarray[idx];
+  if (grid != NULL && idx >= 0 && idx < grid->NR * grid->NC) {
+    return gridcell_at(&grid->cells, idx);
   } else {
-    return NULL;
+    return gridcell_at(NULL, idx);
   }
 }
 
@@ -111,77 +184,391 @@ char* grid_get_map(grid_t* grid) {
 }
 
 /* loads given file into grid. See 'grid.h' for more info. */
-void grid_load(grid_t* grid, char* pathName) 
+bool grid_load(grid_t* grid, char* pathName) 
 {
   // check arguments
   if (grid == NULL || pathName == NULL) {
       fprintf(stderr, "Null grid or Pathname");
-      return;
+      return false;
   }
 
   // open file, check if worked
-  FILE* fp;
-  fp = fopen(pathName, "r");
-  if (fp == NULL) {
+  int fd = open(pathName, O_RDONLY);
+  if (fd < 0) {
     fprintf(stderr, "Failed to open file: %s\n", pathName);
-    fclose(fp);
-    return;
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) < 0 || info.st_size == 0) {
+    fprintf(stderr, "Empty or unreadable map file: %s\n", pathName);
+    close(fd);
+    return false;
   }
-   
-  // get number of columns
-  char* lineOne = file_readLine(fp);
-  int numCols = strlen(lineOne);
-  grid->NC = numCols;
-  rewind(fp);
-  free(lineOne);
 
-  //get number of rows
-  int numRows = file_numLines(fp);
-  grid->NR = numRows;
+  // map the whole file, and read it straight from there
+  size_t size = info.st_size;
+  const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Failed to map file: %s\n", pathName);
+    return false;
+  }
 
-  // allocate for gridarray
-  grid->gridarray = mem_assert(malloc(numRows * numCols * sizeof(gridcell_t*)), "gridarray memory error");
-
-
-  // for each character, concatenate to end of string with strncat
-  char* map = malloc((numRows)*(numCols+1) + 1); // string of all the characters in the map
-  map[0] = '\0'; // initialize with null terminator
-  char* line;
-  char newLine = '\n';
-  int totalIdx = 0;
-  for (int i = 0; (line = file_readLine(fp)) != NULL; i++) {
-
-    for (int j = 0; j < numCols; j++) {
-      char c = line[j];
-      strncat(map, &c, 1);   // add to map
-      
-      // create new gridcell at the approprate (x,y)
-      // math: x = number of characters so far (totalIdx) $mod$ numCols
-      // y = totalIdx / numCols, rounded down (by casting as int)
-      gridcell_t* gridcell = gridcell_new(c, totalIdx % numCols, (int) (totalIdx / numCols), 0, false, false);
-      grid->gridarray[totalIdx] = gridcell;
-      if (c == '-' || c == '|' || c == '+' || c == '#' || c == ' ') {
-        gridcell_setWall(gridcell, true);
-      } else {
-        gridcell_setWall(gridcell, false);
-      }
+  // a compiled map starts with MapMagic; anything else is a text map
+  bool loaded;
+  if (size >= sizeof(mapHeader_t) && memcmp(data, MapMagic, sizeof(MapMagic)) == 0) {
+    loaded = loadBinary(grid, data, size);
+  } else {
+    loaded = loadText(grid, data, size);
+  }
+  if (grid->mapping != data) {
+    munmap((void*) data, size);
+  }
+  if (!loaded) {
+    fprintf(stderr, "Invalid map file: %s\n", pathName);
+  } else {
+    initFreeCells(grid);
+  }
+  return loaded;
+}
 
-      if (c == '.') {
-        gridcell_setRoom(gridcell, true);
-      } else {
-        gridcell_setRoom(gridcell, false);
+/**************** loadText ****************/
+/* Fills in a new grid from the text of a map file. Finds the rows with
+ * memchr, then copies each row once into the cell characters and the
+ * map string. Returns false if there are no cells.
+ */
+static bool
+loadText(grid_t* grid, const char* data, size_t size)
+{
+  // find where each row starts, so that we know the widest one; the bundled
+  // maps include some with ragged rows, blank rows, or DOS line endings
+  int numRows = 0;
+  int numCols = 0;
+  int maxRows = 64;
+  size_t* rowStart = mem_assert(malloc(maxRows * sizeof(size_t)), "rows memory error");
+  int* rowLength = mem_assert(malloc(maxRows * sizeof(int)), "rows memory error");
+  size_t pos = 0;
+  while (pos < size) {
+    const char* newline = memchr(data + pos, '\n', size - pos);
+    size_t len = (newline == NULL) ? size - pos : (size_t) (newline - (data + pos));
+    size_t next = pos + len + 1;
+    if (len > 0 && data[pos + len - 1] == '\r') {
+      len--;
+    }
+    if (len > INT_MAX) {
+      break;
+    }
+    if (numRows == maxRows) {
+      maxRows *= 2;
+      rowStart = mem_assert(realloc(rowStart, maxRows * sizeof(size_t)), "rows memory error");
+      rowLength = mem_assert(realloc(rowLength, maxRows * sizeof(int)), "rows memory error");
+    }
+    rowStart[numRows] = pos;
+    rowLength[numRows] = len;
+    numRows++;
+    if (len > numCols) {
+      numCols = len;
+    }
+    pos = next;
+  }
+  if (pos < size || numCols == 0 || (size_t) numRows * (numCols + 1) >= INT_MAX) {
+    free(rowStart);
+    free(rowLength);
+    return false;
+  }
+  allocCells(grid, numRows, numCols);
+  int totalCells = numRows * numCols;
+
+  // copy each row into the cell characters and the map string,
+  // padding short rows with spaces
+  char* map = grid->map;
+  char* mapRow = map;
+  for (int y = 0; y < numRows; y++) {
+    char* row = grid->chars + numCols * y;
+    memcpy(row, data + rowStart[y], rowLength[y]);
+    memset(row + rowLength[y], ' ', numCols - rowLength[y]);
+    memcpy(mapRow, row, numCols);
+    mapRow[numCols] = '\n';
+    mapRow += numCols + 1;
+  }
+  *mapRow = '\0';
+  free(rowStart);
+  free(rowLength);
+
+  for (int i = 0; i < totalCells; i++) {
+    char c = grid->chars[i];
+    grid->wall[i] = (c == '-' || c == '|' || c == '+' || c == '#' || c == ' ');
+    grid->room[i] = (c == '.');
+  }
+  findRoomCells(grid);
+  return true;
+}
+
+/**************** loadBinary ****************/
+/* Fills in a new grid from a compiled map file (see grid_save), mapped at
+ * 'data'. If the file holds a visibility table, the grid uses it in place
+ * and keeps the file mapped, in grid->mapping, until grid_delete.
+ * Returns false if the file is malformed, including any room cell or
+ * visRow entry that would index outside its array.
+ */
+static bool
+loadBinary(grid_t* grid, const char* data, size_t size)
+{
+  mapHeader_t header;
+  memcpy(&header, data, sizeof(header));
+  if (header.NR <= 0 || header.NC <= 0 || (size_t) header.NR * (header.NC + 1) >= INT_MAX
+      || header.numRoomCells < 0 || header.numRoomCells > header.NR * header.NC
+      || header.numVisRows < 0 || header.numVisRows > header.NR * header.NC) {
+    return false;
+  }
+  size_t offsets[6];
+  if (header.size != size || mapLayout(header.NR, header.NC, header.numRoomCells, header.numVisRows, offsets) != size) {
+    return false;
+  }
+
+  int numRows = header.NR;
+  int numCols = header.NC;
+  int totalCells = numRows * numCols;
+  allocCells(grid, numRows, numCols);
+
+  memcpy(grid->chars, data + offsets[0], totalCells);
+  char* mapRow = grid->map;
+  for (int y = 0; y < numRows; y++) {
+    memcpy(mapRow, grid->chars + numCols * y, numCols);
+    mapRow[numCols] = '\n';
+    mapRow += numCols + 1;
+  }
+  *mapRow = '\0';
+
+  const uint64_t* wallBits = (const uint64_t*) (data + offsets[1]);
+  const uint64_t* roomBits = (const uint64_t*) (data + offsets[2]);
+  int numRoomBits = 0;
+  for (int i = 0; i < totalCells; i++) {
+    grid->wall[i] = (wallBits[i / 64] >> (i % 64)) & 1;
+    grid->room[i] = (roomBits[i / 64] >> (i % 64)) & 1;
+    numRoomBits += grid->room[i];
+  }
+
+  // room cells and visRow entries are used as indexes, so check them all:
+  // the room cells must be exactly the cells of the room bitmap, in order
+  const int32_t* roomCells = (const int32_t*) (data + offsets[3]);
+  if (numRoomBits != header.numRoomCells) {
+    return false;
+  }
+  for (int r = 0; r < header.numRoomCells; r++) {
+    if (roomCells[r] < 0 || roomCells[r] >= totalCells || !grid->room[roomCells[r]]
+        || (r > 0 && roomCells[r] <= roomCells[r - 1])) {
+      return false;
+    }
+  }
+  if (header.numVisRows > 0) {
+    const int32_t* visRow = (const int32_t*) (data + offsets[4]);
+    for (int i = 0; i < totalCells; i++) {
+      if (visRow[i] < -1 || visRow[i] >= header.numVisRows) {
+        return false;
       }
+    }
+  }
+
+  grid->numRoomCells = header.numRoomCells;
+  grid->roomCells = mem_assert(malloc(sizeof(int) * (header.numRoomCells + 1)), "roomCells memory error");
+  memcpy(grid->roomCells, roomCells, sizeof(int) * header.numRoomCells);
+
+  if (header.numVisRows > 0) {
+    grid->visRow = (int*) (data + offsets[4]);
+    grid->visTable = (uint64_t*) (data + offsets[5]);
+    grid->visWords = (totalCells + 63) / 64;
+    grid->numVisRows = header.numVisRows;
+    grid->mapping = (void*) data;
+    grid->mappingSize = size;
+  }
+  return true;
+}
+
+/**************** allocCells ****************/
+/* Sets the size of a new grid, and allocates its map string and per-cell
+ * arrays, with no gold and no players.
+ */
+static void
+allocCells(grid_t* grid, int numRows, int numCols)
+{
+  grid->NC = numCols;
+  grid->NR = numRows;
+
+  // one allocation holds each per-cell array, the ints before the bytes
+  int totalCells = numRows * numCols;
+  grid->gold = mem_assert(malloc(totalCells * (3 * sizeof(int) + sizeof(char) + 2 * sizeof(bool))),
+                          "grid cell memory error");
+  grid->occupant = grid->gold + totalCells;
+  grid->freePos = grid->occupant + totalCells;
+  grid->chars = (char*) (grid->freePos + totalCells);
+  grid->room = (bool*) (grid->chars + totalCells);
+  grid->wall = grid->room + totalCells;
+  grid->cells.c = grid->chars;
+  grid->cells.gold = grid->gold;
+  grid->cells.room = grid->room;
+  grid->cells.isWall = grid->wall;
+  grid->cells.NC = numCols;
+  for (int i = 0; i < totalCells; i++) {
+    grid->gold[i] = 0;
+    grid->occupant[i] = -1;
+  }
+
+  grid->map = mem_assert(malloc((numRows)*(numCols+1) + 1), "map memory error");
+}
 
-      totalIdx++;
+/**************** findRoomCells ****************/
+/* Lists the index of every room cell, in order.
+ */
+static void
+findRoomCells(grid_t* grid)
+{
+  int totalCells = grid->NR * grid->NC;
+  grid->numRoomCells = 0;
+  for (int i = 0; i < totalCells; i++) {
+    grid->numRoomCells += grid->room[i];
+  }
+  grid->roomCells = mem_assert(malloc(sizeof(int) * (grid->numRoomCells + 1)), "roomCells memory error");
+  int count = 0;
+  for (int i = 0; i < totalCells; i++) {
+    if (grid->room[i]) {
+      grid->roomCells[count++] = i;
     }
+  }
+}
 
-    strncat(map, &newLine, 1);
-    free(line);
+/**************** initFreeCells ****************/
+/* Starts the index of free cells: on a new grid, every room cell is free.
+ */
+static void
+initFreeCells(grid_t* grid)
+{
+  int totalCells = grid->NR * grid->NC;
+  for (int i = 0; i < totalCells; i++) {
+    grid->freePos[i] = -1;
   }
+  grid->freeCells = mem_assert(malloc(sizeof(int) * (grid->numRoomCells + 1)), "freeCells memory error");
+  grid->numFreeCells = 0;
+  for (int r = 0; r < grid->numRoomCells; r++) {
+    updateFreeCell(grid, grid->roomCells[r]);
+  }
+}
 
-  grid->map = map; // store this character string in map member
+/**************** updateFreeCell ****************/
+/* Adds a cell to the index of free cells, or removes it, after its gold or
+ * player changed. A removed cell's slot gets the last cell in the list.
+ */
+static void
+updateFreeCell(grid_t* grid, int idx)
+{
+  bool free = grid->room[idx] && grid->gold[idx] == 0 && grid->occupant[idx] == -1;
+  int pos = grid->freePos[idx];
+  if (free && pos < 0) {
+    grid->freePos[idx] = grid->numFreeCells;
+    grid->freeCells[grid->numFreeCells++] = idx;
+  } else if (!free && pos >= 0) {
+    int last = grid->freeCells[--grid->numFreeCells];
+    grid->freeCells[pos] = last;
+    grid->freePos[last] = pos;
+    grid->freePos[idx] = -1;
+  }
+}
 
-  fclose(fp);
+/**************** mapLayout ****************/
+/* Works out where each section of a compiled map file starts (see
+ * mapHeader_t): terrain, wall bitmap, room bitmap, room cells, visRow
+ * and visibility rows. Returns the size of the whole file.
+ */
+static size_t
+mapLayout(int NR, int NC, int numRoomCells, int numVisRows, size_t offsets[6])
+{
+  size_t totalCells = (size_t) NR * NC;
+  size_t words = (totalCells + 63) / 64;
+  size_t sizes[6] = {
+    totalCells,
+    words * sizeof(uint64_t),
+    words * sizeof(uint64_t),
+    numRoomCells * sizeof(int32_t),
+    (numVisRows > 0) ? totalCells * sizeof(int32_t) : 0,
+    (size_t) numVisRows * words * sizeof(uint64_t),
+  };
+  size_t offset = sizeof(mapHeader_t);
+  for (int s = 0; s < 6; s++) {
+    offset = (offset + 7) & ~(size_t) 7;
+    offsets[s] = offset;
+    offset += sizes[s];
+  }
+  return offset;
+}
+
+/* save a compiled map. See 'grid.h' for more info. */
+bool grid_save(grid_t* grid, const char* pathName, bool withVisibility)
+{
+  if (grid == NULL || pathName == NULL || grid->gold == NULL) {
+    fprintf(stderr, "Null grid or Pathname");
+    return false;
+  }
+  if (withVisibility) {
+    grid_buildVisibility(grid, NULL);
+  }
+
+  mapHeader_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MapMagic, sizeof(MapMagic));
+  header.NR = grid->NR;
+  header.NC = grid->NC;
+  header.numRoomCells = grid->numRoomCells;
+  header.numVisRows = withVisibility ? grid->numVisRows : 0;
+  size_t offsets[6];
+  header.size = mapLayout(header.NR, header.NC, header.numRoomCells, header.numVisRows, offsets);
+
+  // build the file in memory, then write it in one go
+  int totalCells = grid->NR * grid->NC;
+  char* file = mem_assert(calloc(1, header.size), "compiled map memory error");
+  memcpy(file, &header, sizeof(header));
+  memcpy(file + offsets[0], grid->chars, totalCells);
+  uint64_t* wallBits = (uint64_t*) (file + offsets[1]);
+  uint64_t* roomBits = (uint64_t*) (file + offsets[2]);
+  for (int i = 0; i < totalCells; i++) {
+    wallBits[i / 64] |= (uint64_t) grid->wall[i] << (i % 64);
+    roomBits[i / 64] |= (uint64_t) grid->room[i] << (i % 64);
+  }
+  memcpy(file + offsets[3], grid->roomCells, sizeof(int) * grid->numRoomCells);
+  if (header.numVisRows > 0) {
+    memcpy(file + offsets[4], grid->visRow, sizeof(int) * totalCells);
+    memcpy(file + offsets[5], grid->visTable, (size_t) grid->numVisRows * grid->visWords * sizeof(uint64_t));
+  }
+
+  FILE* fp = fopen(pathName, "wb");
+  bool saved = (fp != NULL && fwrite(file, 1, header.size, fp) == header.size);
+  if (fp != NULL && fclose(fp) != 0) {
+    saved = false;
+  }
+  if (!saved) {
+    fprintf(stderr, "Failed to write file: %s\n", pathName);
+  }
+  free(file);
+  return saved;
+}
+
+const int* grid_getFreeCells(grid_t* grid, int* count)
+{
+  if (grid == NULL || count == NULL) {
+    fprintf(stderr, "Null argument in grid_getFreeCells");
+    return NULL;
+  }
+  *count = grid->numFreeCells;
+  return grid->freeCells;
+}
+
+const int* grid_getRoomCells(grid_t* grid, int* count)
+{
+  if (grid == NULL || count == NULL) {
+    fprintf(stderr, "Null argument in grid_getRoomCells");
+    return NULL;
+  }
+  *count = grid->numRoomCells;
+  return grid->roomCells;
 }
 
 /* set a gridcell at a certain location x,y to a certain character c. See 'grid.h' for more info */
@@ -195,31 +582,84 @@ void grid_set(grid_t* grid, int x, int y, char c)
     int idxarray = grid->NC * y + x;
     int idxmap = (grid->NC+1) * y + x;
 
-    gridcell_set(grid->gridarray[idxarray], c);
+    grid->chars[idxarray] = c;
     grid->map[idxmap] = c;
   }
 }
 
-//gives the map string to print given a grid
+//gives the map string to print given a grid: terrain, with gold and players on top
 void grid_update_map(grid_t* grid) {
-  int totalCells = (grid->NC) * (grid->NR);
-  mem_free(grid->map);
-  grid->map = (char*) mem_malloc(sizeof(char) * (totalCells + grid->NR));
+  grid_renderMap(grid, grid->map);
+}
+
+int grid_renderMap(grid_t* grid, char* buf) {
   int index = 0;
-  for (int i = 0; i < totalCells; i++) {
+  int i = 0;
+  for (int y = 0; y < grid->NR; y++) {
+    for (int x = 0; x < grid->NC; x++, i++) {
+      if (grid->occupant[i] >= 0) {
+        buf[index++] = grid_occupantLetter(grid->occupant[i]);
+      } else if (grid->gold[i] > 0) {
+        buf[index++] = '*';
+      } else {
+        buf[index++] = grid->chars[i];
+      }
+    }
+    buf[index++] = '\n';
+  }
+  buf[index] = '\0';
+  return index;
+}
 
-    gridcell_t* cell = grid->gridarray[i];
-    char c = gridcell_getC(cell);
-    grid->map[index] = c;
-    index++;
+/* get what a cell shows. See 'grid.h' for more info */
+char grid_getDisplayChar(grid_t* grid, int x, int y)
+{
+  if (grid == NULL || x < 0 || y < 0 || x >= grid->NC || y >= grid->NR) {
+    fprintf(stderr, "Invalid arguments for grid_getDisplayChar");
+    return '\0';
+  }
+  int idx = grid->NC * y + x;
+  if (grid->occupant[idx] >= 0) {
+    return grid_occupantLetter(grid->occupant[idx]);
+  } else if (grid->gold[idx] > 0) {
+    return '*';
+  } else {
+    return grid->chars[idx];
+  }
+}
 
-    //at end of row?
-    if (((i+1) % grid->NC) == 0) {
-      grid->map[index] = '\n';
-      index++;
-    }
+int grid_getOccupant(grid_t* grid, int x, int y)
+{
+  if (grid == NULL || x < 0 || y < 0 || x >= grid->NC || y >= grid->NR) {
+    fprintf(stderr, "Invalid arguments for grid_getOccupant");
+    return -1;
+  }
+  return grid->occupant[grid->NC * y + x];
+}
 
+void grid_setOccupant(grid_t* grid, int x, int y, int id)
+{
+  if (grid == NULL || x < 0 || y < 0 || x >= grid->NC || y >= grid->NR) {
+    fprintf(stderr, "Invalid arguments for grid_setOccupant");
+    return;
   }
+  grid->occupant[grid->NC * y + x] = id;
+  updateFreeCell(grid, grid->NC * y + x);
+}
+
+void grid_setGold(grid_t* grid, int x, int y, int gold)
+{
+  if (grid == NULL || x < 0 || y < 0 || x >= grid->NC || y >= grid->NR) {
+    fprintf(stderr, "Invalid arguments for grid_setGold");
+    return;
+  }
+  grid->gold[grid->NC * y + x] = gold;
+  updateFreeCell(grid, grid->NC * y + x);
+}
+
+char grid_occupantLetter(int id)
+{
+  return 'A' + id % 26;
 }
 
 void grid_iterate(grid_t* grid, void* arg, void (*itemfunc)(void* arg, void* item))
@@ -228,7 +668,8 @@ void grid_iterate(grid_t* grid, void* arg, void (*itemfunc)(void* arg, void* ite
     fprintf(stderr, "One or more 'iterate' arguments is NULL");
   } else {
     for (int i = 0; i < (grid->NR * grid->NC); i++) {
-      (*itemfunc)(arg, grid->gridarray[i]);
+      gridcell_t gridcell = gridcell_at(&grid->cells, i);
+      (*itemfunc)(arg, &gridcell);
     }
   }
 
@@ -236,20 +677,101 @@ void grid_iterate(grid_t* grid, void* arg, void (*itemfunc)(void* arg, void* ite
 
 
 /* check if a terget gridcell is visible from the player gridcell. See 'grid.h' for more info */
-bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target)
+bool grid_isVisible(grid_t* grid, gridcell_t player, gridcell_t target)
 {
-  if (grid == NULL || player == NULL || target == NULL) {
+  if (grid == NULL || !gridcell_isValid(player) || !gridcell_isValid(target)) {
     fprintf(stderr, "One or more visibility arguments is NULL");
     return false;
   }
 
+  int startX = gridcell_getX(player);
+  int startY = gridcell_getY(player);
+  int endX = gridcell_getX(target);
+  int endY = gridcell_getY(target);
 
-  int startX = gridcell_getX(player);       // 0
-  int startY = gridcell_getY(player);       // 0
+  // use the precomputed table if we have a row for the player's cell
+  const uint64_t* row = grid_getVisibility(grid, startX, startY);
+  if (row != NULL) {
+    int idx = grid->NC * endY + endX;
+    return (row[idx / 64] >> (idx % 64)) & 1;
+  }
 
-  int endX = gridcell_getX(target);         // 2
-  int endY = gridcell_getY(target);         // 3
+  return rayIsVisible(grid, startX, startY, endX, endY);
+}
 
+/* compute everything visible from a location. See 'grid.h' for more info */
+void grid_fieldOfView(grid_t* grid, int x, int y, uint64_t* visible)
+{
+  if (grid == NULL || visible == NULL || x < 0 || y < 0 || x >= grid->NC || y >= grid->NR) {
+    fprintf(stderr, "Invalid arguments for grid_fieldOfView");
+    return;
+  }
+
+  int totalCells = grid->NR * grid->NC;
+  int words = (totalCells + 63) / 64;
+
+  const uint64_t* row = grid_getVisibility(grid, x, y);
+  if (row != NULL) {
+    memcpy(visible, row, sizeof(uint64_t) * words);
+    return;
+  }
+
+  if (grid->fovQueue == NULL) {
+    grid->fovQueue = mem_assert(malloc(sizeof(int) * totalCells), "fovQueue memory error");
+    grid->fovExamined = mem_assert(malloc(sizeof(uint64_t) * words), "fovExamined memory error");
+  }
+  uint64_t* examined = grid->fovExamined;
+  int* queue = grid->fovQueue;
+  memset(visible, 0, sizeof(uint64_t) * words);
+  memset(examined, 0, sizeof(uint64_t) * words);
+
+  // flood outward from the player through visible cells and through open
+  // floor, seen or not, since some cells can only be seen past a corner;
+  // each cell is examined at most once, with one ray walk, so the cost is
+  // the connected area times the ray length
+  int head = 0;
+  int tail = 0;
+  int start = grid->NC * y + x;
+  visible[start / 64] |= (uint64_t)1 << (start % 64);
+  examined[start / 64] |= (uint64_t)1 << (start % 64);
+  queue[tail++] = start;
+
+  while (head < tail) {
+    int from = queue[head++];
+    int fromX = from % grid->NC;
+    int fromY = from / grid->NC;
+
+    for (int ny = fromY - 1; ny <= fromY + 1; ny++) {
+      for (int nx = fromX - 1; nx <= fromX + 1; nx++) {
+        if (nx < 0 || ny < 0 || nx >= grid->NC || ny >= grid->NR) {
+          continue;
+        }
+        int idx = grid->NC * ny + nx;
+        uint64_t bit = (uint64_t)1 << (idx % 64);
+        if (examined[idx / 64] & bit) {
+          continue;
+        }
+        examined[idx / 64] |= bit;
+
+        bool vis = rayIsVisible(grid, x, y, nx, ny);
+        if (vis) {
+          visible[idx / 64] |= bit;
+        }
+        if (vis || !grid->wall[idx]) {
+          queue[tail++] = idx;
+        }
+      }
+    }
+  }
+}
+
+/**************** rayIsVisible ****************/
+/* walk the line from (startX, startY) to (endX, endY), checking the
+ * cells it passes between for walls. See IMPLEMENTATION.md.
+ */
+static bool
+rayIsVisible(grid_t* grid, int startX, int startY, int endX, int endY)
+{
   int dx = endX - startX;                   // 2
   int dy = endY - startY;                   // 3
 
@@ -260,8 +782,7 @@ bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target)
 
   if (dx == 0 && dy > 0) { // vertical line, going down
     for (int y = startY + 1; y < endY; y++) {
-      gridcell_t* g = grid_get(grid, startX, y);
-      if (gridcell_isWall(g)) {
+      if (grid->wall[grid->NC * y + startX]) {
         return false;
       }
     }
@@ -271,8 +792,7 @@ bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target)
 
   if (dx == 0 && dy < 0) { // vertical line, going up
     for (int y = startY - 1; y > endY; y--) {
-      gridcell_t* g = grid_get(grid, startX, y);
-      if (gridcell_isWall(g)) {
+      if (grid->wall[grid->NC * y + startX]) {
         return false;
       }
     }
@@ -282,8 +802,7 @@ bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target)
 
   if (dy == 0 && dx > 0) { // horizontal line, going right
     for (int x = startX + 1; x < endX; x++) {
-      gridcell_t* g = grid_get(grid, x, startY);
-      if (gridcell_isWall(g)) {
+      if (grid->wall[grid->NC * startY + x]) {
         return false;
       }
     }
@@ -293,8 +812,7 @@ bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target)
 
   if (dy == 0 && dx < 0) { // horizontal line, going left
     for (int x = startX - 1; x > endX; x--) {
-      gridcell_t* g = grid_get(grid, x, startY);
-      if (gridcell_isWall(g)) {
+      if (grid->wall[grid->NC * startY + x]) {
         return false;
       }
     }
@@ -335,11 +853,8 @@ bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target)
     int underIdx = grid->NC * underY + x;
     int overIdx = grid->NC * overY + x; 
 
-    gridcell_t* underG = grid->gridarray[underIdx];
-    gridcell_t* overG = grid->gridarray[overIdx];
-
     // check if both are wall
-    if (gridcell_isWall(underG) && gridcell_isWall(overG)) {
+    if (grid->wall[underIdx] && grid->wall[overIdx]) {
       return false;
     }
   }
@@ -354,14 +869,11 @@ bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target)
     int underX = floor(x);  // 0
     int overX = ceil(x);   // 1
 
-    // indices in gridarray
+    // cell indices
     int underIdy = grid->NC * y + underX;
     int overIdy = grid->NC * y + overX;
 
-    gridcell_t* underg = grid->gridarray[underIdy];
-    gridcell_t* overg = grid->gridarray[overIdy];
-
-    if (gridcell_isWall(underg) && gridcell_isWall(overg)) {
+    if (grid->wall[underIdy] && grid->wall[overIdy]) {
       return false;
     }
   }
@@ -370,50 +882,257 @@ bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target)
 }
 
 
-/* create the gold piles in a grid. see 'grid.h' for more info */
-void grid_generateGold(grid_t* grid, int minPiles, int maxPiles, int goldTotal)
+bool grid_isEnclosed(grid_t* grid, int idx)
 {
-  if (grid != NULL && minPiles > 0 && maxPiles > minPiles) {
-    // get random integer
-    int range = maxPiles - minPiles;
-    srand(getpid());
-    int numPiles = rand() % range + minPiles; // fits random number in between minPiles and maxPiles
-    printf("Piles: %d\n", numPiles);
+  if (grid == NULL || idx < 0 || idx >= grid->NR * grid->NC) {
+    fprintf(stderr, "Invalid arguments for grid_isEnclosed");
+    return false;
+  }
 
-    int goldLeft = goldTotal;
-    int i = 0;
-    while (i < numPiles) {
-      int randLocation = rand() % (grid->NC * grid->NR); // random integer from 0 to grid->NC * grid->NR
-      gridcell_t* goldTarget = grid->gridarray[randLocation];
+  int x = idx % grid->NC;
+  int y = idx / grid->NC;
+  for (int ny = y - 1; ny <= y + 1; ny++) {
+    for (int nx = x - 1; nx <= x + 1; nx++) {
+      if ((nx != x || ny != y) && nx >= 0 && ny >= 0 && nx < grid->NC && ny < grid->NR
+          && !grid->wall[grid->NC * ny + nx]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 
-      if (gridcell_getC(goldTarget) == '.') { // if gridcell is blank and in a room
+/* build or load the visibility table. See 'grid.h' for more info */
+void grid_buildVisibility(grid_t* grid, const char* cachePath)
+{
+  if (grid == NULL || grid->gold == NULL) {
+    fprintf(stderr, "Null grid in grid_buildVisibility");
+    return;
+  }
+  if (grid->visTable != NULL) {
+    return; // already built
+  }
 
-        int goldAmt = rand() % (goldLeft - (numPiles - i)) + 1;
-        if (i == numPiles - 1) {
-          goldAmt = goldLeft;
-        }
-        printf("i = %d, goldamt = %d, goldLeft = %d\n", i, goldAmt, goldLeft);
+  if (cachePath != NULL && readVisibility(grid, cachePath)) {
+    return;
+  }
+
+  int totalCells = grid->NR * grid->NC;
+
+  // every room or passage cell, where a player can stand, gets a row
+  grid->visRow = mem_assert(malloc(sizeof(int) * totalCells), "visRow memory error");
+  grid->numVisRows = 0;
+  for (int i = 0; i < totalCells; i++) {
+    char c = grid->chars[i];
+    if (c == '.' || c == '#') {
+      grid->visRow[i] = grid->numVisRows++;
+    } else {
+      grid->visRow[i] = -1;
+    }
+  }
+
+  // targets that are enclosed by walls can only be seen from next door
+  bool* enclosed = mem_assert(malloc(sizeof(bool) * totalCells), "enclosed memory error");
+  for (int i = 0; i < totalCells; i++) {
+    enclosed[i] = grid_isEnclosed(grid, i);
+  }
 
-        gridcell_setGold(goldTarget, goldAmt);
+  grid->visWords = (totalCells + 63) / 64;
+  grid->visTable = mem_assert(calloc((size_t)grid->numVisRows * grid->visWords, sizeof(uint64_t)),
+                              "visTable memory error");
 
-        goldLeft -= goldAmt;
-        i++;
+  for (int from = 0; from < totalCells; from++) {
+    if (grid->visRow[from] < 0) {
+      continue;
+    }
+    uint64_t* row = grid->visTable + (size_t)grid->visRow[from] * grid->visWords;
+    int fromX = from % grid->NC;
+    int fromY = from / grid->NC;
+
+    for (int to = 0; to < totalCells; to++) {
+      int toX = to % grid->NC;
+      int toY = to / grid->NC;
+      bool nextDoor = abs(toX - fromX) <= 1 && abs(toY - fromY) <= 1;
+      if (nextDoor || (!enclosed[to] && rayIsVisible(grid, fromX, fromY, toX, toY))) {
+        row[to / 64] |= (uint64_t)1 << (to % 64);
       }
     }
-    printf("%d\n", goldLeft);
+  }
+  free(enclosed);
+
+  if (cachePath != NULL) {
+    writeVisibility(grid, cachePath);
   }
 }
 
-gridcell_t* grid_get(grid_t* grid, int x, int y)
+const char* grid_getChars(grid_t* grid)
 {
-  if (grid == NULL || x < 0 || y < 0) {
-    fprintf(stderr, "Invalid arguments for grid_get");
+  if (grid == NULL) {
+    fprintf(stderr, "Grid null in grid_getChars");
     return NULL;
   }
+  return grid->chars;
+}
+
+const int* grid_getGold(grid_t* grid)
+{
+  if (grid == NULL) {
+    fprintf(stderr, "Grid null in grid_getGold");
+    return NULL;
+  }
+  return grid->gold;
+}
+
+const int* grid_getOccupants(grid_t* grid)
+{
+  if (grid == NULL) {
+    fprintf(stderr, "Grid null in grid_getOccupants");
+    return NULL;
+  }
+  return grid->occupant;
+}
+
+const uint64_t* grid_getVisibility(grid_t* grid, int x, int y)
+{
+  if (grid == NULL || grid->visTable == NULL
+      || x < 0 || y < 0 || x >= grid->NC || y >= grid->NR) {
+    return NULL;
+  }
+
+  int row = grid->visRow[grid->NC * y + x];
+  if (row < 0) {
+    return NULL;
+  }
+  return grid->visTable + (size_t)row * grid->visWords;
+}
+
+/**************** wallHash ****************/
+/* FNV-1a hash of the map size and wall layout, which is all that
+ * visibility depends on; used to tell whether a cache file is stale.
+ */
+static uint64_t
+wallHash(grid_t* grid)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  int totalCells = grid->NR * grid->NC;
+  hash = (hash ^ (uint64_t)grid->NR) * 1099511628211ULL;
+  hash = (hash ^ (uint64_t)grid->NC) * 1099511628211ULL;
+  for (int i = 0; i < totalCells; i++) {
+    uint64_t bits = grid->wall[i] | (grid->visRow[i] >= 0) << 1;
+    hash = (hash ^ bits) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**************** readVisibility ****************/
+/* load the visibility table from cachePath.
+ * Returns false, leaving the grid untouched, if the file is missing,
+ * malformed, or was built for a different map; a visRow that does not
+ * number the rows as grid_buildVisibility would counts as malformed.
+ */
+static bool
+readVisibility(grid_t* grid, const char* cachePath)
+{
+  FILE* fp = fopen(cachePath, "rb");
+  if (fp == NULL) {
+    return false;
+  }
+
+  char magic[8];
+  int header[3];          // NR, NC, numVisRows
+  uint64_t hash;
+  int totalCells = grid->NR * grid->NC;
+  if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)
+      || memcmp(magic, VisMagic, sizeof(magic)) != 0
+      || fread(header, sizeof(int), 3, fp) != 3
+      || header[0] != grid->NR || header[1] != grid->NC || header[2] < 0
+      || fread(&hash, sizeof(hash), 1, fp) != 1) {
+    fclose(fp);
+    return false;
+  }
+
+  int* visRow = mem_assert(malloc(sizeof(int) * totalCells), "visRow memory error");
+  if (fread(visRow, sizeof(int), totalCells, fp) != totalCells) {
+    free(visRow);
+    fclose(fp);
+    return false;
+  }
+
+  // visRow must number the room and passage cells 0, 1, 2... in cell
+  // order, as grid_buildVisibility does, and the header must count them
+  int numVisRows = 0;
+  bool numbered = true;
+  for (int i = 0; i < totalCells && numbered; i++) {
+    char c = grid->chars[i];
+    numbered = (visRow[i] == ((c == '.' || c == '#') ? numVisRows++ : -1));
+  }
+  if (!numbered || numVisRows != header[2]) {
+    free(visRow);
+    fclose(fp);
+    return false;
+  }
+
+  // the hash covers the walls too, so check it before trusting the rest
+  grid->visRow = visRow;
+  if (hash != wallHash(grid)) {
+    grid->visRow = NULL;
+    free(visRow);
+    fclose(fp);
+    return false;
+  }
+
+  int visWords = (totalCells + 63) / 64;
+  size_t tableWords = (size_t)header[2] * visWords;
+  uint64_t* visTable = mem_assert(malloc(sizeof(uint64_t) * (tableWords + 1)), "visTable memory error");
+  if (fread(visTable, sizeof(uint64_t), tableWords, fp) != tableWords) {
+    grid->visRow = NULL;
+    free(visRow);
+    free(visTable);
+    fclose(fp);
+    return false;
+  }
+  fclose(fp);
+
+  grid->visTable = visTable;
+  grid->visWords = visWords;
+  grid->numVisRows = header[2];
+  return true;
+}
+
+/**************** writeVisibility ****************/
+/* save the visibility table to cachePath so the next load can skip
+ * building it. Failing to write the cache is not an error.
+ */
+static void
+writeVisibility(grid_t* grid, const char* cachePath)
+{
+  FILE* fp = fopen(cachePath, "wb");
+  if (fp == NULL) {
+    fprintf(stderr, "could not write visibility cache %s\n", cachePath);
+    return;
+  }
+
+  int header[3] = { grid->NR, grid->NC, grid->numVisRows };
+  uint64_t hash = wallHash(grid);
+  size_t tableWords = (size_t)grid->numVisRows * grid->visWords;
+  fwrite(VisMagic, 1, sizeof(VisMagic), fp);
+  fwrite(header, sizeof(int), 3, fp);
+  fwrite(&hash, sizeof(hash), 1, fp);
+  fwrite(grid->visRow, sizeof(int), grid->NR * grid->NC, fp);
+  fwrite(grid->visTable, sizeof(uint64_t), tableWords, fp);
+  fclose(fp);
+}
+
+gridcell_t grid_get(grid_t* grid, int x, int y)
+{
+  if (grid == NULL || x < 0 || y < 0 || x >= grid->NC || y >= grid->NR) {
+    fprintf(stderr, "Invalid arguments for grid_get");
+    return gridcell_at(NULL, 0);
+  }
 
   // calculate idx
   int idx = grid->NC * y + x;
-  return grid->gridarray[idx];
+  return gridcell_at(&grid->cells, idx);
 }
 
 void grid_print(grid_t* grid)
@@ -423,13 +1142,19 @@ void grid_print(grid_t* grid)
 
 void grid_delete(grid_t* grid)
  {
-  int arraySize = grid->NR * grid->NC;   // calculate size of gridarray
-
-  for (int i = 0; i < arraySize; i++) {
-    gridcell_delete(grid->gridarray[i]);
-  }
-
+  // all the per-cell arrays are one allocation
   free(grid->map);
-  free(grid->gridarray);
+  free(grid->gold);
+  free(grid->roomCells);
+  free(grid->freeCells);
+  if (grid->mapping != NULL) {
+    // the visibility table lives in the compiled map file
+    munmap(grid->mapping, grid->mappingSize);
+  } else {
+    free(grid->visRow);
+    free(grid->visTable);
+  }
+  free(grid->fovQueue);
+  free(grid->fovExamined);
   free(grid);
  }
@@ -17,13 +17,19 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <stdint.h>
 #include "file.h"
 #include "mem.h"
 #include "gridcell.h"
 
 /*
 * grid struct, including members:
-*   gridcell_t** gridArray;
+*   gridcells_t cells;       - the per-cell arrays below, for gridcell views
+*   char* chars;             - dense per-cell arrays, all in one allocation;
+*   int* gold;                 chars is the terrain, and gold and occupant
+*   int* occupant;             are the layer of things on top of it
+*   bool* room;
+*   bool* wall;
 *   Int NR;
 *   Int NC;
 */
@@ -56,12 +62,79 @@ int grid_get_NR(grid_t* grid);
 int grid_get_NC(grid_t* grid);
 
 /******* grid_get_gridarray ******
- * get a gridcell from the gridarray
+ * get a gridcell by its index, NC * y + x
  * input: 
  *     grid of interest
  *     index at which the gridcell is
+ * output:
+ *     a view of the cell, not valid (see gridcell_isValid) if idx is out of range
  */
-gridcell_t* grid_get_gridarray(grid_t* grid, int idx);
+gridcell_t grid_get_gridarray(grid_t* grid, int idx);
+
+/******* grid_getChars ******
+ * get the dense array of terrain characters, NR*NC long with no newlines;
+ * cell (x,y) is at index NC*y + x. Owned by the grid; read-only.
+ * input: grid of interest
+ */
+const char* grid_getChars(grid_t* grid);
+
+/******* grid_getGold ******
+ * get the dense array of gold per cell, NR*NC long, indexed like
+ * grid_getChars. Owned by the grid; read-only.
+ * input: grid of interest
+ */
+const int* grid_getGold(grid_t* grid);
+
+/******* grid_getOccupants ******
+ * get the dense array of occupants, NR*NC long, indexed like
+ * grid_getChars: the id of the player in each cell, or -1.
+ * Owned by the grid; read-only.
+ * input: grid of interest
+ */
+const int* grid_getOccupants(grid_t* grid);
+
+/******* grid_getOccupant ******
+ * get the id of the player at (x,y), or -1 if there is none
+ */
+int grid_getOccupant(grid_t* grid, int x, int y);
+
+/******* grid_setOccupant ******
+ * put the player with the given id at (x,y); -1 empties the cell.
+ * Leaves the terrain alone.
+ */
+void grid_setOccupant(grid_t* grid, int x, int y, int id);
+
+/******* grid_setGold ******
+ * put a pile of gold at (x,y); 0 empties the cell.
+ * Use this rather than gridcell_setGold, which grid_getFreeCells
+ * does not see.
+ */
+void grid_setGold(grid_t* grid, int x, int y, int gold);
+
+/******* grid_getFreeCells ******
+ * get the index (y*NC + x) of every free cell: a room cell with no gold
+ * and no player. The list is kept up to date by grid_setOccupant and
+ * grid_setGold, which add or remove one cell in constant time, so it is
+ * in no particular order.
+ * inputs:
+ *     grid - a loaded grid
+ *     count - set to the number of free cells; 0 if the map is full
+ * outputs:
+ *     the list, owned by the grid and changed by the next grid_setOccupant
+ *     or grid_setGold; NULL if grid or count is NULL
+ */
+const int* grid_getFreeCells(grid_t* grid, int* count);
+
+/******* grid_occupantLetter ******
+ * get the letter that shows the player with the given id: 'A' + id % 26
+ */
+char grid_occupantLetter(int id);
+
+/******* grid_getDisplayChar ******
+ * get what the cell at (x,y) shows: its occupant's letter, else '*'
+ * if it holds gold, else its terrain character
+ */
+char grid_getDisplayChar(grid_t* grid, int x, int y);
 
 
 
@@ -74,18 +147,52 @@ gridcell_t* grid_get_gridarray(grid_t* grid, int idx);
  *    grid - Pointer to the grid structure to be populated with data from the file.
  *    pathName - Path name of the file to be read.
  * output:
- *    the grid->map and grid->gridarray members will be filled according to the 
- *    map file that's passed in
+ *    true if the map loaded; the grid->map and the per-cell arrays will be
+ *    filled according to the map file that's passed in.
+ *    false, after printing an error, if the file cannot be read or has no cells.
  * Note:
  *    The grid structure must be allocated before calling this function.
- *    The file should contain characters representing the grid, with each character corresponding to a cell in the grid.
- *    The file is assumed to be a valid rectangular map
+ *    The file is mapped into memory and read in one pass over its rows.
+ *    Rows may end in "\n" or "\r\n"; a row shorter than the widest one is
+ *    padded with spaces, so the grid is always rectangular.
+ *    The file may instead be a compiled map, written by grid_save; its
+ *    cells are copied in without parsing, and its visibility table, if it
+ *    has one, is used in place until grid_delete.
  */
-void grid_load(grid_t* grid, char* pathName);
+bool grid_load(grid_t* grid, char* pathName);
+
+/********** grid_save *********
+ * Save a loaded grid as a compiled map, which grid_load reads back.
+ *
+ * Input:
+ *    grid - a grid loaded with grid_load
+ *    pathName - file to write
+ *    withVisibility - also save the visibility table, building it first
+ *                     (with grid_buildVisibility) if need be
+ * output:
+ *    true if the file was written; false, after printing an error, if not.
+ * Note:
+ *    The compiled map holds the terrain, a wall bitmap and a room bitmap,
+ *    the list of room cells, and maybe the visibility table, each section
+ *    laid out so it can be used straight from memory. It uses the byte
+ *    order of the machine that wrote it. Gold and players are not saved.
+ */
+bool grid_save(grid_t* grid, const char* pathName, bool withVisibility);
+
+/********** grid_getRoomCells *********
+ * get the index (y*NC + x) of every room cell, in order
+ *
+ * inputs:
+ *     grid - a loaded grid
+ *     count - set to the number of room cells
+ * outputs:
+ *     the list, owned by the grid; NULL if grid or count is NULL
+ */
+const int* grid_getRoomCells(grid_t* grid, int* count);
 
 
 /*********** grid_set **************
- * change the character at a certain location in the grid
+ * change the terrain character at a certain location in the grid
  * inputs:
  *     grid - grid whose character we're changing
  *     x - x coordinate of location to change
@@ -93,7 +200,7 @@ void grid_load(grid_t* grid, char* pathName);
  *     c - character to change to
  * outputs:
  *     character is changed at the appropriate index
- *     in the gridarray of gridcells and the char* map
+ *     in the per-cell terrain and the char* map
  * 
  */
 void grid_set(grid_t* grid, int x, int y, char c);
@@ -106,9 +213,10 @@ void grid_set(grid_t* grid, int x, int y, char c);
  *     x - x position of gridcell to get
  *     y - y position
  * outputs:
- *     pointer to the gridcell at the corresponding location
+ *     a view of the gridcell at the corresponding location, which is not
+ *     valid (see gridcell_isValid) if the location is off the grid
  */
-gridcell_t* grid_get(grid_t* grid, int x, int y);
+gridcell_t grid_get(grid_t* grid, int x, int y);
 
 /******** grid_print *********
  * prints the char* map of the grid
@@ -122,10 +230,23 @@ void grid_print(grid_t* grid);
  * input:
  *     grid - grid whose string we are working with
  * output:
- *     Old grid->map freed. New string stored into grid->map.
+ *     grid->map rewritten in place, in one pass: the terrain, with
+ *     gold and players drawn over it
  */
 void grid_update_map(grid_t* grid);
 
+/*********** grid_renderMap ***********
+ * draws the map, as grid_update_map does, into a buffer of the caller's
+ * 
+ * input:
+ *     grid - grid of interest
+ *     buf - room for NR*(NC+1)+1 chars
+ * output:
+ *     buf holds the rows, each ending in '\n', then '\0';
+ *     returns the number of chars before the '\0'
+ */
+int grid_renderMap(grid_t* grid, char* buf);
+
 
 /******** grid_iterate *********
  * iterate over all the gridcells in the grid
@@ -135,7 +256,8 @@ void grid_update_map(grid_t* grid);
  *     arg - pointer to an object passed in, if necessary
  *     (*itemfunc) - function that acts on the gridcells
  * outputs:
- *     the itemfunc function is performed on every gridcell, which are modified in the grid
+ *     the itemfunc function is performed on every gridcell, which are modified in the grid;
+ *     item points to a gridcell_t that is only valid during the call
  */
 void grid_iterate(grid_t* grid, void* arg, void (*itemfunc)(void* arg, void* item));
 
@@ -154,34 +276,79 @@ void grid_iterate(grid_t* grid, void* arg, void (*itemfunc)(void* arg, void* ite
  * notes:
  *     pseudocode for this function is in IMPLEMENTATION.md and is not repeated here
  *     function is memory-neutral
+ *     once grid_buildVisibility has been called, this is a table lookup
+ *     whenever the player is on a room or passage cell
  */
-bool grid_isVisible(grid_t* grid, gridcell_t* player, gridcell_t* target);
-
+bool grid_isVisible(grid_t* grid, gridcell_t player, gridcell_t target);
 
+/********** grid_fieldOfView **************
+ * compute every cell visible from a location
+ * 
+ * inputs:
+ *     grid - grid of interest
+ *     x, y - location of the viewer
+ *     visible - caller-provided bitset of (NR*NC+63)/64 words
+ * outputs:
+ *     visible has bit idx%64 of word idx/64 set for each visible cell,
+ *     exactly the cells for which grid_isVisible would return true
+ * notes:
+ *     floods outward from the viewer through every visible cell and every
+ *     non-wall cell connected to it, visible or not, and walks a ray to
+ *     each cell it reaches, once. That is not a shadowcast: the cost is
+ *     O(R * L), R the cells reached (the open area connected to the viewer
+ *     and the walls around it) and L the ray length, up to max(NR, NC).
+ *     Copies the precomputed row instead, in O(NR*NC/64), if
+ *     grid_buildVisibility was called.
+ */
+void grid_fieldOfView(grid_t* grid, int x, int y, uint64_t* visible);
 
+/********** grid_isEnclosed **************
+ * are all eight neighbors of a cell walls (or off the map)?
+ * 
+ * inputs:
+ *     grid - grid of interest
+ *     idx - index of the cell, NC * y + x
+ * outputs:
+ *     bool - true if enclosed
+ * notes:
+ *     an enclosed cell is only ever visible from right next to it,
+ *     since every longer line of sight passes through a neighbor
+ */
+bool grid_isEnclosed(grid_t* grid, int idx);
 
-/********* grid_generateGold ***********
- * create a random number of gold piles in a grid, between minPiles and maxPiles
+/********** grid_buildVisibility **************
+ * precompute which cells are visible from every room and passage cell
  * 
  * inputs:
- *     grid - grid into which we're putting gold
- *     minPiles - minimum number of piles for randomization
- *     maxPiles - maximum number of piles
- *     goldTotal - int value for the total amount of gold between all piles
+ *     grid - grid that was just loaded with grid_load
+ *     cachePath - file to load the table from, or to save it to if it
+ *                 is missing or stale. May be NULL to skip the cache.
  * outputs:
- *     gridcell->gold value is increased for the cells that are randomly selected
- *
+ *     grid_isVisible and grid_getVisibility use the table from now on
+ * notes:
+ *     room and passage cells are found by their terrain characters,
+ *     so gold and players may already be placed. Building takes a while on big maps; loading the cache does not.
  */
-void grid_generateGold(grid_t* grid, int minPiles, int maxPiles, int goldTotal);
+void grid_buildVisibility(grid_t* grid, const char* cachePath);
 
+/********** grid_getVisibility **************
+ * get the precomputed visibility bitset for a location
+ * 
+ * inputs:
+ *     grid - grid of interest
+ *     x, y - location of the viewer
+ * outputs:
+ *     bitset with one bit per cell (bit idx%64 of word idx/64), set
+ *     if that cell is visible from (x,y); NULL if there is no table
+ *     or no row for that location. Owned by the grid.
+ */
+const uint64_t* grid_getVisibility(grid_t* grid, int x, int y);
 
-// grid_updateGold(grid_t* grid)
 
-// grid_getGold(grid_t* grid)
 
 
 /********** grid_delete ************
- * Deletes the grid struct, its map and gridarray
+ * Deletes the grid struct, its map and per-cell arrays
  * Input:
  *     grid - grid to delete
  * output:
@@ -3,9 +3,10 @@
  * Team 17 - CecsC
  * 
  * gridcell.c - CS50 'gridcell' module
- * The gridcell module defines each individual piece of the gridcell,
- * storing its character (wall, blank, gold, etc), its location, and
- * whether or not it can be seen 
+ * The gridcell module gives a view of each individual piece of the grid:
+ * its character (wall, blank, gold, etc), its location, and whether or
+ * not it is in a room. The state itself lives in the grid's per-cell
+ * arrays; a gridcell is only an index into them.
  *
  * see gridcell.h for more information.
  *
@@ -22,159 +23,126 @@
 /**************** file-local global variables ****************/
 /* none */
 
-/**************** global types ****************/
-typedef struct gridcell {
-  char c;                       // actual makeup of cell
-  int x;                        // x position in grid
-  int y;                        //y position in grid
-  int gold;                        //amount of gold in place, 0 if none
-  bool show;                    //if cell can be seen by player or not
-  bool room;                    // is cell in a room?
-  bool isWall;                  // is cell a wall?
-} gridcell_t;
 
-
-
-gridcell_t* gridcell_new(char c, int x, int y, int gold, bool show, bool room) 
+gridcell_t gridcell_at(const gridcells_t* cells, int idx)
 {
-  // check args
-  if (x < 0 || y < 0 || gold < 0) {
-    fprintf(stderr, "invalid gridcell_new parameters");
-    return NULL;
+  gridcell_t gridcell = { NULL, 0 };
+  if (cells != NULL && idx >= 0) {
+    gridcell.cells = cells;
+    gridcell.idx = idx;
   }
-
-  gridcell_t* gridcell = mem_assert(malloc(sizeof(gridcell_t)), "Gridcell allocation error");
-  
-  gridcell->c = c;
-  gridcell->x = x;
-  gridcell->y = y;
-  gridcell->gold = gold;
-  gridcell->show = show;
-  gridcell->room = room;
-
   return gridcell;
 }
 
+bool gridcell_isValid(gridcell_t gridcell)
+{
+  return gridcell.cells != NULL;
+}
 
-void gridcell_set(gridcell_t* gridcell, char c)
+
+void gridcell_set(gridcell_t gridcell, char c)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_set");
+    return;
   }
 
-  gridcell->c = c;
+  gridcell.cells->c[gridcell.idx] = c;
 }
 
-char gridcell_getC(gridcell_t* gridcell) 
+char gridcell_getC(gridcell_t gridcell) 
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     return '\0';
   }
 
-  return gridcell->c;
+  return gridcell.cells->c[gridcell.idx];
 }
 
-int gridcell_getX(gridcell_t* gridcell)
+int gridcell_getX(gridcell_t gridcell)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_getX");
+    return 0;
   }
 
-  return gridcell->x;
+  return gridcell.idx % gridcell.cells->NC;
 }
 
-int gridcell_getY(gridcell_t* gridcell)
+int gridcell_getY(gridcell_t gridcell)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_getY");
     return 0;
   }
 
-  return gridcell->y;
+  return gridcell.idx / gridcell.cells->NC;
 }
 
-void gridcell_setGold(gridcell_t* gridcell, int gold)
+void gridcell_setGold(gridcell_t gridcell, int gold)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_setGold");
   } else {
-    gridcell->gold = gold;
+    gridcell.cells->gold[gridcell.idx] = gold;
   }
 }
 
-int gridcell_getGold(gridcell_t* gridcell)
+int gridcell_getGold(gridcell_t gridcell)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_getGold");
     return 0;
   }
 
-  return gridcell->gold;
+  return gridcell.cells->gold[gridcell.idx];
 }
 
-void gridcell_setWall(gridcell_t* gridcell, bool isWall)
+void gridcell_setWall(gridcell_t gridcell, bool isWall)
 {
-  if (gridcell == NULL) {
-    fprintf(stderr, "gridcell null in gridcell_getY");
+  if (gridcell.cells == NULL) {
+    fprintf(stderr, "gridcell null in gridcell_setWall");
   } else {
-    gridcell->isWall = isWall;
+    gridcell.cells->isWall[gridcell.idx] = isWall;
   }
 }
 
-bool gridcell_isWall(gridcell_t* gridcell)
+bool gridcell_isWall(gridcell_t gridcell)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_isWall");
     return false;
   }
 
-  return gridcell->isWall;
+  return gridcell.cells->isWall[gridcell.idx];
 }
 
-void gridcell_setShow(gridcell_t* gridcell, bool show) {
-  if (gridcell == NULL) {
-    fprintf(stderr, "gridcell null in gridcell_isWall");
-  } else {
-    gridcell->show = show;
-  }
-
-}
-
-void gridcell_setRoom(gridcell_t* gridcell, bool room)
+void gridcell_setRoom(gridcell_t gridcell, bool room)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_setRoom");
   } else {
-    gridcell->room = room;
+    gridcell.cells->room[gridcell.idx] = room;
   }
 }
 
-bool gridcell_getRoom(gridcell_t* gridcell)
+bool gridcell_getRoom(gridcell_t gridcell)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_getRoom");
     return false;
   } else {
-    return gridcell->room;
+    return gridcell.cells->room[gridcell.idx];
   }
 }
 
-void gridcell_print(gridcell_t* gridcell)
+void gridcell_print(gridcell_t gridcell)
 {
-  if (gridcell == NULL) {
+  if (gridcell.cells == NULL) {
     fprintf(stderr, "gridcell null in gridcell_print");
+    return;
   }
 
-  printf("%c\n", gridcell->c);
-
-}
-
+  printf("%c\n", gridcell.cells->c[gridcell.idx]);
 
-void gridcell_delete(gridcell_t* gridcell)
-{
-  if (gridcell == NULL) {
-    fprintf(stderr, "Null gridcell to delete\n");
-  } else {
-    free(gridcell);
-  }
 }
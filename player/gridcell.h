@@ -6,39 +6,59 @@
  * 
  */
 
+#ifndef __GRIDCELL_H
+#define __GRIDCELL_H
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "mem.h"
 
+// Gridcells struct
+/* The dense per-cell arrays of a grid, NR*NC long, which its gridcells view;
+ * cell i is at (i % NC, i / NC).
+ */
+typedef struct gridcells {
+  char* c;                      // actual makeup of each cell
+  int* gold;                    // amount of gold in each cell, 0 if none
+  bool* room;                   // is each cell in a room?
+  bool* isWall;                 // is each cell a wall?
+  int NC;                       // number of columns
+} gridcells_t;
+
 // Gridcell struct
-/*
- *  char c;             // actual makeup of cell
- * int x;               // x position in grid
- * int y;               // y position in grid
- * int gold;            //amount of gold in place, 0 if none
- * bool show;           //if cell can be seen by player or not
+/* A gridcell is a view of one cell of a grid: which arrays, and which
+ * element of them. It is two words with no storage of its own, so it is
+ * passed and returned by value, and nothing needs to be freed.
+ * A gridcell whose 'cells' is NULL is no cell at all (see gridcell_isValid).
  */
-typedef struct gridcell gridcell_t;
+typedef struct gridcell {
+  const gridcells_t* cells;     // the grid's per-cell arrays
+  int idx;                      // index of the cell in those arrays
+} gridcell_t;
 
 // functions
-/*********** gridcell_new ***********
- * create a new gridcell struct
+/*********** gridcell_at ***********
+ * get a view of cell number idx of a grid's per-cell arrays
  * 
  * Inputs:
- *     c - the character of the cell
- *     x - x position in the grid
- *     y - y position
- *     gold - the amount of gold there
- *     show - boolean: is this visible?
- *     room - boolean: is this cell in a room?
+ *     cells - the grid's per-cell arrays
+ *     idx - index of the cell, NC * y + x
  * outputs:
- *     a new gridcell struct
- * notes:
- *     caller must later free this via gridcell_delete()
+ *     the gridcell, which is not valid if cells is NULL or idx < 0
+ */
+gridcell_t gridcell_at(const gridcells_t* cells, int idx);
+
+/*********** gridcell_isValid ***********
+ * is this gridcell a cell of a grid?
+ * 
+ * input:
+ *     gridcell - gridcell of interest
+ * output:
+ *     false for the gridcell returned for a bad position (see grid_get)
  */
-gridcell_t* gridcell_new(char c, int x, int y, int gold, bool show, bool room);
+bool gridcell_isValid(gridcell_t gridcell);
 
 
 /********* GETTER AND SETTER METHODS FOR GRIDCELLS **********/
@@ -50,7 +70,7 @@ gridcell_t* gridcell_new(char c, int x, int y, int gold, bool show, bool room);
  *     gridcell - gridcell we're setting
  *     c - character we're setting it to
  */
-void gridcell_set(gridcell_t* gridcell, char c);
+void gridcell_set(gridcell_t gridcell, char c);
 
 /******** gridcell_getX *******
  * get x position of a gridcell
@@ -59,7 +79,7 @@ void gridcell_set(gridcell_t* gridcell, char c);
  * output:
  *     int - the x position
  */
-int gridcell_getX(gridcell_t* gridcell);
+int gridcell_getX(gridcell_t gridcell);
 
 /******** gridcell_getY *******
  * get Y position of a gridcell
@@ -68,16 +88,17 @@ int gridcell_getX(gridcell_t* gridcell);
  * output:
  *     int - the y position
  */
-int gridcell_getY(gridcell_t* gridcell);
+int gridcell_getY(gridcell_t gridcell);
 
 /******** gridcell_getC *******
  * get character of a gridcell
  * input:
  *     gridcell - gridcell of interest
  * output:
- *     char - the character at the gridcell
+ *     char - the character at the gridcell; for a cell of a grid, its
+ *     terrain, without any gold or player on it (see grid_getDisplayChar)
  */
-char gridcell_getC(gridcell_t* gridcell);
+char gridcell_getC(gridcell_t gridcell);
 
 
 /******** gridcell_setGold *******
@@ -87,7 +108,7 @@ char gridcell_getC(gridcell_t* gridcell);
  * output:
  *     changes gridcell->gold
  */
-void gridcell_setGold(gridcell_t* gridcell, int gold);
+void gridcell_setGold(gridcell_t gridcell, int gold);
 
 
 /******** gridcell_getGold *******
@@ -97,7 +118,7 @@ void gridcell_setGold(gridcell_t* gridcell, int gold);
  * output:
  *     int - the gold
  */
-int gridcell_getGold(gridcell_t* gridcell);
+int gridcell_getGold(gridcell_t gridcell);
 
 /******** gridcell_setWall *******
  * set whether or not a certain gridcell is a wall
@@ -106,7 +127,7 @@ int gridcell_getGold(gridcell_t* gridcell);
  * output:
  *     gridcell->wall becomes what you set it too (isWall)
  */
-void gridcell_setWall(gridcell_t* gridcell, bool isWall);
+void gridcell_setWall(gridcell_t gridcell, bool isWall);
 
 /******** gridcell_isWall *******
  * get bool if gridcell is a wall
@@ -115,16 +136,7 @@ void gridcell_setWall(gridcell_t* gridcell, bool isWall);
  * output:
  *     bool - true if it's a wall, false if not
  */
-bool gridcell_isWall(gridcell_t* gridcell);
-
-/******** gridcell_setShow *******
- * set show boolean for specific gridcell
- * input:
- *     gridcell - gridcell of interest
- * output:
- *     gridcell->show becomes what you set it too (show)
- */
-void gridcell_setShow(gridcell_t* gridcell, bool show);
+bool gridcell_isWall(gridcell_t gridcell);
 
 /******* gridcell_setRoom ********
  * set whether or not a gridcell is in a room
@@ -132,16 +144,16 @@ void gridcell_setShow(gridcell_t* gridcell, bool show);
  *     gridcell - gridcell of interest
  *     room - whether or not it's in a room
  */
-void gridcell_setRoom(gridcell_t* gridcell, bool room);
+void gridcell_setRoom(gridcell_t gridcell, bool room);
 
-/******* gridcell_setRoom ********
+/******* gridcell_getRoom ********
  * check whether or not a gridcell is in a room
  * inputs:
  *     gridcell - gridcell of interest
  * outputs:
  *     bool - whether or not it's in a room
  */
-bool gridcell_getRoom(gridcell_t* gridcell);
+bool gridcell_getRoom(gridcell_t gridcell);
 
 
 /******** gridcell_print *******
@@ -153,17 +165,6 @@ bool gridcell_getRoom(gridcell_t* gridcell);
  * notes:
  *     mostly used for debugging
  */
-void gridcell_print(gridcell_t* gridcell);
-
-/******** gridcell_delete *******
- * delete gridcell struct
- * input:
- *     gridcell - gridcell to delete
- * output:
- *     gridcell is completely freed, along with its members
- * note:
- *     gridcell must have been created with gridcell_new
- */
-void gridcell_delete(gridcell_t* gridcell);
-
+void gridcell_print(gridcell_t gridcell);
 
+#endif // __GRIDCELL_H
@@ -1,5 +1,9 @@
 /*
  * gridtest.c - testing for grid
+ *
+ * Loads and prints three maps. Then checks every cell of each, through the
+ * gridcell API, against the text of the map file: character, position,
+ * wall, room and gold.
  * 
  * CS50 Nuggets Final Project
  * Team 17 - CecsC
@@ -7,10 +11,14 @@
 
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include "grid.h"
 #include "gridcell.h"
 
+static int compareCells(grid_t* grid, const char* pathName);
+
 int main()
 {
     grid_t* small = grid_new();
@@ -30,8 +38,57 @@ int main()
     printf("\n-------------------------------------------------\n");
     grid_print(ateam);
 
+    // the cells, as the grid stores them, against the map files
+    printf("\n-------------------------------------------------\n");
+    int differences = compareCells(small, "../maps/small.txt")
+                    + compareCells(main, "../maps/main.txt")
+                    + compareCells(ateam, "../maps/contrib21s/ateam.txt");
+
     grid_delete(small);
     grid_delete(main);
     grid_delete(ateam);
+    return differences == 0 ? 0 : 1;
+}
+
+/* compare every cell of a loaded grid with the character at the same place
+ * in the map file; short rows count as padded with spaces. Prints and returns the number
+ * of cells that differ.
+ */
+static int compareCells(grid_t* grid, const char* pathName)
+{
+    FILE* fp = fopen(pathName, "r");
+    if (fp == NULL) {
+        printf("%s: cannot open\n", pathName);
+        return 1;
+    }
+    int NR = grid_get_NR(grid);
+    int NC = grid_get_NC(grid);
+    char line[NC + 3];
+    int differences = 0;
+    for (int y = 0; y < NR; y++) {
+        if (fgets(line, sizeof(line), fp) == NULL) {
+            line[0] = '\0';
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        int length = strlen(line);
+
+        for (int x = 0; x < NC; x++) {
+            char c = (x < length) ? line[x] : ' ';
+            bool wall = c == '-' || c == '|' || c == '+' || c == '#' || c == ' ';
+
+            gridcell_t cell = grid_get_gridarray(grid, NC * y + x);
+            if (gridcell_getC(cell) != c
+                || gridcell_getX(cell) != x
+                || gridcell_getY(cell) != y
+                || gridcell_isWall(cell) != wall
+                || gridcell_getRoom(cell) != (c == '.')
+                || gridcell_getGold(cell) != 0) {
+                differences++;
+            }
+        }
+    }
+    fclose(fp);
 
+    printf("%s: %d cells, %d differ\n", pathName, NR * NC, differences);
+    return differences;
 }
\ No newline at end of file
@@ -0,0 +1,203 @@
+/*
+ * maptest.c - round-trip test for compiled maps
+ *
+ * For every map named on the command line, saves it with grid_save, both
+ * with and without the visibility table, loads each compiled map back with
+ * grid_load, and checks that every cell, the room-cell list and the
+ * visibility table match the text map. Also checks that a truncated
+ * compiled map is refused, as is one with a room cell or visRow entry
+ * out of range. Prints one line per map and exits nonzero if
+ * any map differs.
+ *
+ * usage: ./maptest map...
+ *
+ * CS50 Nuggets Final Project
+ * Team 17 - CecsC
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "grid.h"
+#include "gridcell.h"
+
+static const char* tmpPath = "maptest.tmp";
+
+static int checkMap(char* pathName);
+static int compareGrids(grid_t* text, grid_t* compiled, bool withVisibility);
+static bool corruptedIsRefused(long offset, int32_t value);
+static bool truncatedIsRefused(void);
+static long align8(long offset);
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s map...\n", argv[0]);
+        return 1;
+    }
+
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        int differences = checkMap(argv[i]);
+        printf("%s: %s", argv[i], differences == 0 ? "ok\n" : "DIFFERENT");
+        if (differences != 0) {
+            printf(" (%d differences)\n", differences);
+            failed++;
+        }
+    }
+    remove(tmpPath);
+
+    printf("%d of %d maps match\n", argc - 1 - failed, argc - 1);
+    return failed == 0 ? 0 : 1;
+}
+
+/* round-trip one map through a compiled map, without and then with the
+ * visibility table; return the number of differences found
+ */
+static int checkMap(char* pathName)
+{
+    grid_t* text = grid_new();
+    if (!grid_load(text, pathName)) {
+        grid_delete(text);
+        return 1;
+    }
+    // the cache keeps the test quick on big maps
+    char visCachePath[strlen(pathName) + 5];
+    sprintf(visCachePath, "%s.vis", pathName);
+    grid_buildVisibility(text, visCachePath);
+
+    int differences = 0;
+    for (int withVisibility = 0; withVisibility <= 1; withVisibility++) {
+        grid_t* compiled = grid_new();
+        if (!grid_save(text, tmpPath, withVisibility) || !grid_load(compiled, (char*) tmpPath)) {
+            differences++;
+        }
+        else {
+            differences += compareGrids(text, compiled, withVisibility);
+        }
+        grid_delete(compiled);
+    }
+
+    // tmpPath now holds the map with the table; find its room cells and
+    // visRow sections as grid.c lays them out (see mapHeader_t there)
+    int totalCells = grid_get_NR(text) * grid_get_NC(text);
+    long words = (totalCells + 63) / 64;
+    int numRoomCells;
+    grid_getRoomCells(text, &numRoomCells);
+    long roomCellsAt = align8(align8(align8(32 + totalCells) + 8 * words) + 8 * words);
+    long visRowAt = align8(roomCellsAt + 4 * numRoomCells);
+    if ((numRoomCells > 0 && !corruptedIsRefused(roomCellsAt, totalCells))
+        || !corruptedIsRefused(visRowAt + 4 * (totalCells - 1), totalCells)) {
+        differences++;
+    }
+    if (!truncatedIsRefused()) {
+        differences++;
+    }
+
+    grid_delete(text);
+    return differences;
+}
+
+/* compare a compiled map with the text map it came from */
+static int compareGrids(grid_t* text, grid_t* compiled, bool withVisibility)
+{
+    int NR = grid_get_NR(text);
+    int NC = grid_get_NC(text);
+    if (grid_get_NR(compiled) != NR || grid_get_NC(compiled) != NC) {
+        return 1;
+    }
+    int differences = 0;
+    if (strcmp(grid_get_map(text), grid_get_map(compiled)) != 0) {
+        differences++;
+    }
+
+    int totalCells = NR * NC;
+    int words = (totalCells + 63) / 64;
+    for (int i = 0; i < totalCells; i++) {
+        gridcell_t a = grid_get_gridarray(text, i);
+        gridcell_t b = grid_get_gridarray(compiled, i);
+        if (gridcell_getC(a) != gridcell_getC(b) || gridcell_isWall(a) != gridcell_isWall(b)
+            || gridcell_getRoom(a) != gridcell_getRoom(b) || gridcell_getGold(b) != 0
+            || grid_getOccupant(compiled, i % NC, i / NC) != -1) {
+            differences++;
+        }
+
+        // a compiled map without the table has no visibility until it is built
+        const uint64_t* visA = grid_getVisibility(text, i % NC, i / NC);
+        const uint64_t* visB = grid_getVisibility(compiled, i % NC, i / NC);
+        if (!withVisibility) {
+            differences += (visB != NULL);
+        }
+        else if ((visA == NULL) != (visB == NULL)
+                 || (visA != NULL && memcmp(visA, visB, words * sizeof(uint64_t)) != 0)) {
+            differences++;
+        }
+    }
+
+    int countA, countB;
+    const int* roomA = grid_getRoomCells(text, &countA);
+    const int* roomB = grid_getRoomCells(compiled, &countB);
+    if (countA != countB || memcmp(roomA, roomB, countA * sizeof(int)) != 0) {
+        differences++;
+    }
+    return differences;
+}
+
+/* overwrite the int at 'offset' in the compiled map at tmpPath with 'value';
+ * grid_load must refuse it. Puts the old value back afterwards.
+ */
+static bool corruptedIsRefused(long offset, int32_t value)
+{
+    FILE* fp = fopen(tmpPath, "r+b");
+    int32_t old;
+    if (fp == NULL || fseek(fp, offset, SEEK_SET) != 0 || fread(&old, sizeof(old), 1, fp) != 1) {
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        return false;
+    }
+    fseek(fp, offset, SEEK_SET);
+    fwrite(&value, sizeof(value), 1, fp);
+    fflush(fp);
+
+    grid_t* grid = grid_new();
+    bool loaded = grid_load(grid, (char*) tmpPath);
+    grid_delete(grid);
+
+    fseek(fp, offset, SEEK_SET);
+    fwrite(&old, sizeof(old), 1, fp);
+    fclose(fp);
+    return !loaded;
+}
+
+/* round an offset in a compiled map up to the next section boundary */
+static long align8(long offset)
+{
+    return (offset + 7) & ~7L;
+}
+
+/* chop the last byte off the compiled map at tmpPath; grid_load must refuse it */
+static bool truncatedIsRefused(void)
+{
+    FILE* fp = fopen(tmpPath, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    char* bytes = malloc(size);
+    size_t got = fread(bytes, 1, size, fp);
+    fclose(fp);
+    fp = fopen(tmpPath, "wb");
+    fwrite(bytes, 1, got - 1, fp);
+    fclose(fp);
+    free(bytes);
+
+    grid_t* grid = grid_new();
+    bool loaded = grid_load(grid, (char*) tmpPath);
+    grid_delete(grid);
+    return !loaded;
+}
@@ -10,15 +10,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "mem.h"
 #include "grid.h"
 #include "message.h"
+#include "trace.h"
 
 /**************** global types ****************/
 typedef struct player {
-  bool* boolGrid;       // personal map of what they can see
+  uint64_t* boolGrid;   // personal map of what they have seen, 64 cells per word
+  uint64_t* visibleNow; // bitset of cells visible from (visX, visY)
+  int words;            // number of words in boolGrid and visibleNow
+  int visX;             // location at the last visibility update
+  int visY;             // location at the last visibility update
   char c;               //what character they are
-  const char* name;           //what they say their name is
+  char* name;           //what they say their name is; the player's own copy
   int score;            //current score
   int x;                //location
   int y;                //location
@@ -29,6 +35,9 @@ typedef struct player {
 // IMPLICIT DECLARATIONS
 int player_get_x(player_t* player);
 int player_get_y(player_t* player);
+bool player_get_boolGrid(player_t* player, int index);
+void player_set_name(player_t* player, const char* name);
+int player_renderString(player_t* player, grid_t* grid, char* map);
 
 
 
@@ -36,13 +45,16 @@ player_t* player_new(char c, const char* name, addr_t addr, int NR, int NC) {
 
     player_t* player = mem_malloc(sizeof(player_t));
 
-    player->boolGrid = mem_malloc(sizeof(bool) * (NR * NC));  
-    for (int i = 0; i < (NR * NC); i++) {
-      player->boolGrid[i] = false;
-    }
+    player->words = (NR * NC + 63) / 64;
+    player->boolGrid = mem_calloc(player->words, sizeof(uint64_t));
+
+    player->visibleNow = mem_malloc(sizeof(uint64_t) * player->words);
+    player->visX = -1;
+    player->visY = -1;
 
     player->c = c;
-    player->name = name;
+    player->name = NULL;
+    player_set_name(player, name);
     player->score = 0;
     player->x = 0;
     player->y = 0;
@@ -55,12 +67,19 @@ player_t* player_new(char c, const char* name, addr_t addr, int NR, int NC) {
 
 void player_delete(player_t* player) {
 
+  if (player == NULL) {
+    return;
+  }
   if (player->boolGrid != NULL) {
     mem_free(player->boolGrid);
   }
-  if (player != NULL) {
-    mem_free(player);
+  if (player->visibleNow != NULL) {
+    mem_free(player->visibleNow);
   }
+  if (player->name != NULL) {
+    mem_free(player->name);
+  }
+  mem_free(player);
 }
 
 
@@ -70,31 +89,108 @@ void player_playerVisibility(player_t* player, grid_t* grid)
     fprintf(stderr, "Null argument(s) in player_playerVisibility");
   } else {
 
-    gridcell_t* g = grid_get(grid, player_get_x(player), player_get_y(player));
-
+    // one field-of-view pass instead of checking every cell on its own
+    grid_fieldOfView(grid, player_get_x(player), player_get_y(player), player->visibleNow);
+    player->visX = player_get_x(player);
+    player->visY = player_get_y(player);
+
+#if TRACE_LEVEL >= TRACE_FRAME
+    if (trace_enabled(TRACE_FRAME)) {
+      for (int i = 0; i < grid_get_NC(grid) * grid_get_NR(grid); i++) {
+        if (!player_get_boolGrid(player, i)) { // if it's false in the bool grid (we don't have to worry about true, can't turn to false)
+          gridcell_t g1 = grid_get_gridarray(grid, i);
+          bool show = (player->visibleNow[i / 64] >> (i % 64)) & 1;
+          TRACE(TRACE_FRAME, "player", "cell", "x=%d y=%d show=%d wall=%d c='%c'",
+                gridcell_getX(g1), gridcell_getY(g1), show, gridcell_isWall(g1), gridcell_getC(g1));
+        }
+      }
+    }
+#endif
 
-    for (int i = 0; i < grid_get_NC(grid) * grid_get_NR(grid); i++) {
+    for (int w = 0; w < player->words; w++) {
+      player->boolGrid[w] |= player->visibleNow[w];
+    }
 
-      if (!player->boolGrid[i]) { // if it's false in the bool grid (we don't have to worry about true, can't turn to false)
-        gridcell_t* g1 = grid_get_gridarray(grid, i);
-        bool show = grid_isVisible(grid, g, g1); // check visibility
-        printf("(%d, %d): show = %d, wall = %d, character: %c\n", gridcell_getX(g1), gridcell_getY(g1), show, gridcell_isWall(g1), gridcell_getC(g1));
-        player->boolGrid[i] = show; // set that in the boolGrid
+#if TRACE_LEVEL >= TRACE_FRAME
+    // what has been seen, as one row of 0s and 1s per event
+    if (trace_enabled(TRACE_FRAME)) {
+      int NC = grid_get_NC(grid);
+      char row[2 * NC + 1];
+      for (int y = 0; y < grid_get_NR(grid); y++) {
+        for (int x = 0; x < NC; x++) {
+          row[2 * x] = player_get_boolGrid(player, NC * y + x) ? '1' : '0';
+          row[2 * x + 1] = ' ';
+        }
+        row[2 * NC] = '\0';
+        TRACE(TRACE_FRAME, "player", "seen", "y=%d %s", y, row);
       }
     }
+#endif
   }
+}
 
-  bool* testgrid = player->boolGrid;
-  int total = 0;
-  for (int i = 0; i<grid_get_NR(grid); i++){
-    int cnt = 0;
-    while(cnt<grid_get_NC(grid)){
-      cnt++;
-      printf("%d ", testgrid[total]);
-      total++;
+
+void player_updateVisibility(player_t* player, grid_t* grid)
+{
+  if (grid == NULL || player == NULL) {
+    fprintf(stderr, "Null argument(s) in player_updateVisibility");
+    return;
+  }
+
+  int x = player->x;
+  int y = player->y;
+
+  // nothing can change unless the player has moved since the last update
+  if (x == player->visX && y == player->visY) {
+    return;
+  }
+  player->visX = x;
+  player->visY = y;
+
+  grid_fieldOfView(grid, x, y, player->visibleNow);
+
+  // merge what is visible now into what has been seen, a word at a time
+  for (int w = 0; w < player->words; w++) {
+    player->boolGrid[w] |= player->visibleNow[w];
+  }
+}
+
+void player_updatePathVisibility(player_t* player, grid_t* grid, const int* path, int length)
+{
+  if (grid == NULL || player == NULL || (path == NULL && length > 0)) {
+    fprintf(stderr, "Null argument(s) in player_updatePathVisibility");
+    return;
+  }
+
+  int NC = grid_get_NC(grid);
+  for (int i = 0; i < length; i++) {
+    const uint64_t* row = grid_getVisibility(grid, path[i] % NC, path[i] / NC);
+    if (row == NULL) {
+      // no table: use the visible-now set as scratch space
+      grid_fieldOfView(grid, path[i] % NC, path[i] / NC, player->visibleNow);
+      row = player->visibleNow;
+      player->visX = -1;
+    }
+    for (int w = 0; w < player->words; w++) {
+      player->boolGrid[w] |= row[w];
     }
-    printf("\n");
   }
+
+  player_updateVisibility(player, grid);
+}
+
+int player_countSeen(player_t* player)
+{
+  if (player == NULL) {
+    fprintf(stderr, "player is null in player_countSeen\n");
+    return 0;
+  }
+
+  int count = 0;
+  for (int w = 0; w < player->words; w++) {
+    count += __builtin_popcountll(player->boolGrid[w]);
+  }
+  return count;
 }
 
 /***** GETTER / SETTER FUNCTIONS *****/
@@ -107,7 +203,7 @@ addr_t player_get_addr(player_t* player) {
 bool player_get_boolGrid(player_t* player, int index) {
 
   if (player != NULL && player->boolGrid != NULL) {
-    return player->boolGrid[index];
+    return (player->boolGrid[index / 64] >> (index % 64)) & 1;
   } else {
     fprintf(stderr, "player or player boolgrid is null\n");
     return false;
@@ -182,10 +278,17 @@ void player_set_c(player_t* player, char c) {
   }
 }
 
-void player_set_name(player_t* player, char* name) {
+void player_set_name(player_t* player, const char* name) {
 
   if (player != NULL && name != NULL) {
-    player->name = name;
+    char* copy = mem_malloc(strlen(name) + 1);
+    if (copy != NULL) {
+      strcpy(copy, name);
+      if (player->name != NULL) {
+        mem_free(player->name);
+      }
+      player->name = copy;
+    }
   }
 }
 
@@ -200,7 +303,12 @@ void player_set_score(player_t* player, int score) {
 void player_set_boolGrid(player_t* player, int index, bool visible) {
 
   if (player != NULL) {
-    player->boolGrid[index] = visible;
+    uint64_t bit = (uint64_t)1 << (index % 64);
+    if (visible) {
+      player->boolGrid[index / 64] |= bit;
+    } else {
+      player->boolGrid[index / 64] &= ~bit;
+    }
   }
 }
 
@@ -229,53 +337,89 @@ void player_deactivate(player_t* player) {
 }
 
 char* player_get_string(player_t* player, grid_t* grid) {
-  printf("add\n");
-
-  int totalCells = (grid_get_NC(grid)) * (grid_get_NR(grid));
-  char* map = mem_malloc(sizeof(char) * (totalCells + grid_get_NR(grid)) + 1);
-  int index = 0;
-  printf("totalCells: %d\n", totalCells);
+  int NR = grid_get_NR(grid);
+  int NC = grid_get_NC(grid);
+  int totalCells = NC * NR;
+  char* map = mem_malloc(sizeof(char) * (totalCells + NR) + 1);
 
-  for (int i = 0; i < totalCells; i++) {
+  player_renderString(player, grid, map);
+  return map;
+}
 
-    gridcell_t* cell = (grid_get_gridarray(grid, i));                       //new getter needed
-    char c = gridcell_getC(cell);
+int player_renderString(player_t* player, grid_t* grid, char* map) {
+  int NR = grid_get_NR(grid);
+  int NC = grid_get_NC(grid);
+  const char* chars = grid_getChars(grid);
+  const int* gold = grid_getGold(grid);
+  const int* occupants = grid_getOccupants(grid);
+  int index = 0;
 
-    //if cell has been seen
-    if (player_get_boolGrid(player, i)) {
-      printf("%c ",c);
-      if (c == '*') {
+  // the player's visible-now set is only good if they haven't moved since
+  bool haveVisibleNow = (player->visX == player->x && player->visY == player->y);
+  // letters can repeat among players, so find ourselves by location
+  int self = NC * player->y + player->x;
+
+  for (int y = 0; y < NR; y++) {
+    int x = 0;
+    while (x < NC) {
+      int i = NC * y + x;
+      uint64_t word = player->boolGrid[i / 64] >> (i % 64);
+
+      // nothing seen in the rest of this word: blank the whole run at once
+      if (word == 0) {
+        int run = 64 - (i % 64);
+        if (run > NC - x) {
+          run = NC - x;
+        }
+        memset(map + index, ' ', run);
+        index += run;
+        x += run;
+        continue;
+      }
 
-        bool stillVis = grid_isVisible(grid, grid_get(grid, player_get_x(player), player_get_y(player)), cell);
-        if (stillVis) {
-          map[index] = '*';
+      char c = chars[i];
+
+      //if cell has been seen, draw the terrain with gold and players on top
+      if (word & 1) {
+        if (i == self) {
+          map[index] = '@';
+        } else if (occupants[i] >= 0) {
+          map[index] = grid_occupantLetter(occupants[i]);
+        } else if (gold[i] > 0) {
+
+          bool stillVis;
+          if (haveVisibleNow) {
+            stillVis = (player->visibleNow[i / 64] >> (i % 64)) & 1;
+          } else {
+            stillVis = grid_isVisible(grid, grid_get(grid, player_get_x(player), player_get_y(player)),
+                                      grid_get_gridarray(grid, i));
+          }
+          if (stillVis) {
+            map[index] = '*';
+          } else {
+            map[index] = c;
+          }
         } else {
-          map[index] = '.';
+          map[index] = c;
         }
-      } else if (c == player_get_c(player)) {
-        map[index] = '@';
       } else {
-        map[index] = c;
+        map[index] = ' ';
       }
-    } else {
-      printf("0 ");
-      map[index] = ' ';
-    }
-    index++;
-
-    //at end of row?
-    if (((i+1) % grid_get_NC(grid)) == 0) {
-      printf("\n");
-      map[index] = '\n';
       index++;
+      x++;
     }
+
+    //at end of row
+    map[index] = '\n';
+    index++;
   }
 
   map[index] = '\0';
-
-  printf("%s", map);
-
-  return map;
-
+  TRACE(TRACE_FRAME, "player", "render", "letter=%c x=%d y=%d cells=%d", player->c, player->x, player->y, NR * NC);
+#if TRACE_LEVEL >= TRACE_FRAME
+  for (int y = 0; y < NR; y++) {
+    TRACE(TRACE_FRAME, "player", "row", "y=%d %.*s", y, NC, map + y * (NC + 1));
+  }
+#endif
+  return index;
 }
-
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "mem.h"
 #include "grid.h"
 #include "message.h"
@@ -10,6 +11,17 @@
 typedef struct player player_t;
 
 
+/********** player_new ***********
+ * create a new player
+ * 
+ * inputs:
+ *     c - the letter that shows the player on the map
+ *     name - what they say their name is; the player keeps its own copy
+ *     addr - address of their client
+ *     NR, NC - size of the map
+ * output:
+ *     the new player, which the caller later frees with player_delete
+ */
 player_t* player_new(char c, const char* name, const addr_t addr, int NR, int NC);
 
 void player_delete(player_t* player);
@@ -26,10 +38,55 @@ void player_delete(player_t* player);
  */
 void player_playerVisibility(player_t* player, grid_t* grid);
 
+/********** player_updateVisibility ***********
+ * player_playerVisibility for every move: one field-of-view pass per move
+ * 
+ * inputs:
+ *     player - player whose boolGrid we're updating
+ *     grid - grid of interest
+ * output:
+ *     boolGrid is updated accordingly, and the player's visible-now set
+ *     is kept for player_get_string
+ * notes:
+ *     does nothing if the player hasn't moved since the last call.
+ *     Otherwise runs one grid_fieldOfView pass from the player's location;
+ *     this is not a delta from the last location, since one step can
+ *     change the line of sight to any cell of the map.
+ *     Gives the same boolGrid as player_playerVisibility, without the
+ *     debugging output.
+ */
+void player_updateVisibility(player_t* player, grid_t* grid);
+
+/********** player_updatePathVisibility ***********
+ * player_updateVisibility for a player who has just run along a path
+ * 
+ * inputs:
+ *     player - player whose boolGrid we're updating, already at the end
+ *     grid - grid of interest
+ *     path - index (y*NC + x) of each cell passed through on the way,
+ *            not counting the player's location now
+ *     length - number of cells in path
+ * output:
+ *     boolGrid gains everything visible from any cell of the path or from
+ *     the player's location; the visible-now set is from the location.
+ * notes:
+ *     with a visibility table, each path cell costs one OR of its row
+ *     into boolGrid, rather than a full update.
+ */
+void player_updatePathVisibility(player_t* player, grid_t* grid, const int* path, int length);
+
 addr_t player_get_addr(player_t* player);
 
 bool player_get_boolGrid(player_t* player, int index);
 
+/********** player_countSeen ***********
+ * count how many cells of the map the player has seen so far
+ * 
+ * input: player of interest
+ * output: number of cells set in the player's boolGrid
+ */
+int player_countSeen(player_t* player);
+
 char player_get_c(player_t* player);
 
 const char* player_get_name(player_t* player);
@@ -44,7 +101,7 @@ bool player_is_active(player_t* player);
 
 void player_set_c(player_t* player, char c);
 
-void player_set_name(player_t* player, char* name);
+void player_set_name(player_t* player, const char* name);
 
 void player_set_score(player_t* player, int score);
 
@@ -56,4 +113,18 @@ void player_set_y(player_t* player, int y);
 
 void player_deactivate(player_t* player);
 
-char* player_get_string(player_t* player, grid_t* grid);
\ No newline at end of file
+char* player_get_string(player_t* player, grid_t* grid);
+
+/********** player_renderString ***********
+ * draw the player's view of the map into a buffer, as player_get_string
+ * does, without allocating or printing anything
+ * 
+ * inputs:
+ *     player - player whose view we're drawing
+ *     grid - grid of interest
+ *     map - room for NR*(NC+1)+1 chars
+ * output:
+ *     map holds the rows, each ending in '\n', then '\0';
+ *     returns the number of chars before the '\0'
+ */
+int player_renderString(player_t* player, grid_t* grid, char* map);
\ No newline at end of file
@@ -0,0 +1,146 @@
+/*
+ * visbench.c - visibility benchmark over a set of maps
+ *
+ * For every map named on the command line, times:
+ *   - grid_isVisible from every room cell to every cell, first by ray
+ *     casting and then, after grid_buildVisibility, by table lookup;
+ *   - player_playerVisibility from every room cell, with the table;
+ *   - loading the map and building the table.
+ * Prints one CSV line per map, after a header line, so results can be
+ * kept and compared from one release to the next:
+ *
+ *   map,rows,cols,room_cells,load_us,ray_ns_per_query,build_ms,
+ *   table_ns_per_query,player_ns_per_call,player_cells_per_sec,
+ *   table_bytes,max_rss_kb
+ *
+ * player_cells_per_sec counts the cells of the map whose visibility one
+ * player_playerVisibility call settles. table_bytes is the size of the
+ * visibility table; max_rss_kb is the peak size of the whole process so far.
+ *
+ * usage: ./visbench map...
+ *
+ * CS50 Nuggets Final Project
+ * Team 17 - CecsC
+ */
+
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "grid.h"
+#include "gridcell.h"
+#include "player.h"
+#include "message.h"
+
+static void benchMap(char* pathName);
+static long rayQueries(grid_t* grid, const int* roomCells, int numRoomCells);
+static double now(void);
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s map...\n", argv[0]);
+        return 1;
+    }
+
+    printf("map,rows,cols,room_cells,load_us,ray_ns_per_query,build_ms,"
+           "table_ns_per_query,player_ns_per_call,player_cells_per_sec,"
+           "table_bytes,max_rss_kb\n");
+    for (int i = 1; i < argc; i++) {
+        benchMap(argv[i]);
+    }
+    return 0;
+}
+
+/* time every kind of visibility query on one map, and print its CSV line */
+static void benchMap(char* pathName)
+{
+    double start = now();
+    grid_t* grid = grid_new();
+    if (!grid_load(grid, pathName)) {
+        grid_delete(grid);
+        return;
+    }
+    double loadTime = now() - start;
+
+    int NR = grid_get_NR(grid);
+    int NC = grid_get_NC(grid);
+    int totalCells = NR * NC;
+    int numRoomCells;
+    const int* roomCells = grid_getRoomCells(grid, &numRoomCells);
+    long queries = (long) numRoomCells * totalCells;
+
+    // ray casting: no table yet
+    start = now();
+    long visible = rayQueries(grid, roomCells, numRoomCells);
+    double rayTime = now() - start;
+
+    // no cache file, so the table really is built
+    start = now();
+    grid_buildVisibility(grid, NULL);
+    double buildTime = now() - start;
+
+    start = now();
+    long visibleTable = rayQueries(grid, roomCells, numRoomCells);
+    double tableTime = now() - start;
+    if (visibleTable != visible) {
+        fprintf(stderr, "%s: ray casting saw %ld cells, the table %ld\n", pathName, visible, visibleTable);
+    }
+
+    // a fresh player each time, so every call does the whole update
+    start = now();
+    for (int r = 0; r < numRoomCells; r++) {
+        player_t* player = player_new('A', "bench", message_noAddr(), NR, NC);
+        player_set_x(player, roomCells[r] % NC);
+        player_set_y(player, roomCells[r] / NC);
+        player_playerVisibility(player, grid);
+        player_delete(player);
+    }
+    double playerTime = now() - start;
+
+    // one row per room or passage cell, plus the row index of every cell
+    long tableBytes = (long) totalCells * sizeof(int);
+    for (int i = 0; i < totalCells; i++) {
+        if (grid_getVisibility(grid, i % NC, i / NC) != NULL) {
+            tableBytes += (totalCells + 63) / 64 * sizeof(uint64_t);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    double perQuery = (queries > 0) ? 1e9 / queries : 0;
+    double perCall = (numRoomCells > 0) ? 1e9 / numRoomCells : 0;
+    double cellsPerSec = (playerTime > 0) ? (double) numRoomCells * totalCells / playerTime : 0;
+    printf("%s,%d,%d,%d,%.0f,%.2f,%.2f,%.2f,%.0f,%.0f,%ld,%ld\n",
+           pathName, NR, NC, numRoomCells, loadTime * 1e6, rayTime * perQuery, buildTime * 1e3,
+           tableTime * perQuery, playerTime * perCall, cellsPerSec, tableBytes, usage.ru_maxrss);
+    fflush(stdout);
+
+    grid_delete(grid);
+}
+
+/* ask grid_isVisible about every cell from every room cell; return how many are visible */
+static long rayQueries(grid_t* grid, const int* roomCells, int numRoomCells)
+{
+    int totalCells = grid_get_NR(grid) * grid_get_NC(grid);
+    long visible = 0;
+    for (int r = 0; r < numRoomCells; r++) {
+        gridcell_t from = grid_get_gridarray(grid, roomCells[r]);
+        for (int to = 0; to < totalCells; to++) {
+            visible += grid_isVisible(grid, from, grid_get_gridarray(grid, to));
+        }
+    }
+    return visible;
+}
+
+/* seconds on a monotonic clock */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -19,11 +19,11 @@ int main()
     grid_load(visdemo, "../maps/visdemo.txt");
     grid_load(visdemo_to_show, "../maps/visdemo.txt");
 
-    // create gridcells to test visibility between
-    gridcell_t* A = gridcell_new('.', 4, 1, 0, false, false);
-    gridcell_t* g1 = gridcell_new('.', 18, 4, 0, false, false);
-    gridcell_t* g2 = gridcell_new('.', 6, 7, 0, false, false);
-    gridcell_t* g3 = gridcell_new('.', 21, 7, 0, false, false);
+    // get gridcells to test visibility between
+    gridcell_t A = grid_get(visdemo, 4, 1);
+    gridcell_t g1 = grid_get(visdemo, 18, 4);
+    gridcell_t g2 = grid_get(visdemo, 6, 7);
+    gridcell_t g3 = grid_get(visdemo, 21, 7);
 
     // change characters on the show map so that we can see
     grid_set(visdemo_to_show, 4, 1, 'A');
@@ -46,10 +46,6 @@ int main()
     printf("3 Visible from 1: %d\n", vis4);
 
     // clean up
-    gridcell_delete(A);
-    gridcell_delete(g1);
-    gridcell_delete(g2);
-    gridcell_delete(g3);
     grid_delete(visdemo_to_show);
     grid_delete(visdemo);
 }
\ No newline at end of file
@@ -5,14 +5,39 @@
 * the Nuggets game. It receives messages from client and calls the appropriate functions
 * to adjust the game map, players, and more. When the game is over (all the gold is collected),
 * the server sends all clients a game summary.
+*
+* One server process can host several independent games, one per map given on
+* the command line. Each client belongs to one game, chosen when it joins.
+* The process exits when every game is over.
+*
+* With --threads n, the games are shared out among n worker threads, and each
+* game's state is only ever touched by its worker. The main thread reads every
+* datagram, and passes it to the worker that owns the sender's game through a
+* single-producer, single-consumer queue. Workers send their replies directly.
+*
+* The metrics module times each phase of handling messages, and counts the
+* messages received and sent. A STATS message from this machine is answered
+* with those totals and with the bytes sent to each client; with --stats secs,
+* a line of what happened in each interval is written to stderr.
 */
 
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
 
 #include "file.h"
 #include "message.h"
@@ -20,104 +45,300 @@
 #include "player.h"
 #include "grid.h"
 #include "gridcell.h"
+#include "addrtable.h"
+#include "trace.h"
+#include "metrics.h"
+
+/**************** local types ****************/
+/* The last frame sent to one client. A client that asks for DELTA frames
+* gets only the cells that changed since this frame; see sendFrame.
+* Each client's outgoing messages are built in buffers it keeps for the whole
+* game, allocated with its first frame (see frameBuffer), so sending frames
+* allocates nothing. Frames are drawn straight into one of two frame buffers,
+* after room for the "DISPLAY\n" header; the other holds the last frame.
+*/
+typedef struct frameState {
+    char* last;     // last frame sent (rows joined with '\n'), NULL if none
+    int seq;        // sequence number of that frame, 0 before the first
+    bool delta;     // client asked for DELTA instead of DISPLAY
+    bool rle;       // client asked for run-length encoded full frames
+    bool dirty;     // something this client sees changed since that frame
+    char* goldMsg;  // GOLD message; NULL until the first frame
+    int goldPurse;  // purse and gold left in the last GOLD message, -1 if none
+    int goldLeft;
+    int goldFound;  // gold the player picked up since their last GOLD message
+    char* buf[2];   // frame buffers, each FRAME_HEADER bytes then a frame
+    int cur;        // buffer the next frame is drawn in
+    char* deltaMsg; // DELTA message
+    long bytesSent; // in GOLD and frame messages, since the client joined
+    long messagesSent;
+} frameState_t;
+
+/* Room kept in front of each frame for its header: strlen("DISPLAY\n").
+*/
+#define FRAME_HEADER 8
 
-/**************** file-local functions ****************/
+/* Run-length encoding of full frames, for clients that send RLE: a run of
+* RLE_MIN_RUN or more of one character becomes RLE_MARK, a count character
+* (' ' plus the run's length) and the character. See encodeRLE.
+*/
+#define RLE_MARK '~'
+#define RLE_MIN_RUN 4
+#define RLE_MAX_RUN ('~' - ' ')
 
-static bool handleMessage(void* arg, const addr_t from, const char* message);
-static void parseArgs(const int argc, char* argv[], char** mapFileName, int* seed);
-static void addPlayer(addr_t from, const char* name);
-static void addSpectator(addr_t from);
-static void handleKey(player_t* player, const char* key);
-static bool moveOnMap(player_t* player, int newX, int newY);
-static void handleQuit(player_t* player); 
-static void dropGold();
-static void updatePlayers();
-static void updateSpectator();
-static void gameOver();
-
-struct gameData {
+/* One game: a map, and the players and spectator playing on it.
+* Only the game's owner thread touches it, except 'over', which the main
+* thread reads to stop routing messages to a finished game.
+*/
+typedef struct game {
     grid_t* map;
-    player_t* allPlayers[26];
+    player_t** allPlayers;    // numPlayers of them, in the order they joined
+    frameState_t* frames;     // parallel to allPlayers
+    int playerSlots;          // room in allPlayers and frames
+    addrtable_t* playerIndex; // address -> index in allPlayers, for players still in
     addr_t spect;
+    frameState_t spectFrame;
     bool hasSpect;
     int numPlayers;
     int numGold;
     int numRows;
     int numCols;
-    addr_t justFoundGold;
+    int* sprintPath;          // scratch for sprint: the cells of one run
+    unsigned int rng;         // state of this game's random numbers
+    int owner;                // worker thread that owns this game; 0 without threads
+    atomic_bool over;         // game over was sent to its clients
+} game_t;
+
+/* A message on its way from the main thread to a worker.
+*/
+typedef struct inbound {
+    addr_t from;
+    game_t* game;             // NULL for a STATS query, answered by the worker
+    char* message;            // allocated with mem_malloc; the worker frees it
+} inbound_t;
+
+/* A worker thread, and the queue of messages for the games it owns.
+* The main thread only writes 'tail', and the worker only writes 'head'.
+*/
+#define QUEUE_SIZE 1024
+typedef struct worker {
+    pthread_t thread;
+    int wakeFds[2];           // pipe; a byte is written after each message queued
+    inbound_t queue[QUEUE_SIZE];
+    atomic_uint head;         // next message to handle
+    atomic_uint tail;         // next free slot
+    atomic_bool stop;
+} worker_t;
+
+/* Most players in one game. The game-over summary, one line per player,
+* has to fit in one datagram.
+*/
+#define MAX_PLAYERS 500
+
+/**************** file-local functions ****************/
+
+static bool handleMessage(void* arg, const addr_t from, const char* message);
+static void parseArgs(const int argc, char* argv[], char*** mapFileNames, int* numMaps, int* seed, int* tickMs, int* numThreads, int* statsSecs);
+static game_t* gameNew(const char* mapFileName, const int seed);
+static void gameDelete(game_t* game);
+static game_t* findGame(addr_t from);
+static game_t* leastFullGame();
+static void addRoute(addr_t from, game_t* game);
+static int finishGames(int owner);
+static bool allGamesOver();
+static void gameMessage(game_t* game, addr_t from, const char* message);
+static bool handleTimeout(void* arg);
+static bool handleTimer(void* arg, int fd);
+static bool handleGameOver(void* arg, int fd);
+static int startTimer(double seconds, bool (*handler)(void* arg, int fd));
+static bool handleStatsTimer(void* arg, int fd);
+static void handleStats(addr_t from);
+static void sendClientStats(int owner, addr_t to);
+static void handleKeyMessage(game_t* game, addr_t from, const char* keystroke);
+static void runTick(int owner);
+static void startWorkers(int count);
+static void postMessage(int owner, addr_t from, game_t* game, const char* message);
+static void stopWorkers();
+static void* workerMain(void* arg);
+static double now();
+static void addPlayer(game_t* game, addr_t from, const char* name);
+static char playerLetter(int index);
+static void addSpectator(game_t* game, addr_t from);
+static void handleKey(game_t* game, player_t* player, const char* key);
+static bool moveOnMap(game_t* game, player_t* player, int newX, int newY);
+static void sprint(game_t* game, player_t* player, int dx, int dy);
+static void handleQuit(game_t* game, player_t* player); 
+static void dropGold(game_t* game);
+static int randomFreeCell(game_t* game);
+static void updatePlayers(game_t* game);
+static void updateSpectator(game_t* game);
+static void sendUpdates(int owner);
+static void queueMessage(addr_t to, frameState_t* fs, char* message, int length);
+static void flushOutbox();
+static void gameOver(game_t* game);
+static frameState_t* findFrameState(game_t* game, addr_t from);
+static void resetFrameState(frameState_t* fs);
+static char* frameBuffer(game_t* game, frameState_t* fs);
+static int goldMessage(frameState_t* fs, int found, int purse, int left);
+static void sendFrame(addr_t to, frameState_t* fs, int frameLen, int goldLen);
+static void freeFrameState(frameState_t* fs);
+static int encodeDelta(char* buf, const char* prev, const char* frame);
+static int encodeRLE(char* buf, const char* frame, int frameLen);
+static void setOccupant(game_t* game, int x, int y, int id);
+static void markAllChanged(game_t* game);
+
+
+
+/* Every game this server hosts, one per map on the command line.
+*/
+#define MAX_GAMES 64
+static struct serverData {
+    game_t* games[MAX_GAMES];
+    int numGames;
+} server;
+
+/* Which game each client joined. Kept by the main thread, so that it can
+* route messages without touching any game's state.
+*/
+static struct routeTable {
+    addrtable_t* games;       // address -> index in server.games
+    int joined[MAX_GAMES];    // clients sent to each game, to find the least full
+} routing;
+
+/* The worker threads, if any (--threads n).
+* doneFds is a pipe a worker writes to when one of its games ends.
+*/
+static struct workerPool {
+    worker_t* workers;
+    int count;
+    int doneFds[2];
+} pool;
+
+/* Messages queued by updatePlayers and updateSpectator, so that one round
+* of GOLD and frame messages goes out in one message_sendBatch call.
+* Each thread has its own.
+*/
+#define OUTBOX_SIZE 64
+static _Thread_local struct outbox {
+    addr_t to[OUTBOX_SIZE];
+    const char* messages[OUTBOX_SIZE];  // each in some client's frameState
+    int count;
+    long bytes;                         // in the messages queued
+} outbox;
+
+/* Tick mode (--tick ms): keystrokes are queued as they arrive and applied
+* together once per tick, followed by one round of frames. Without it,
+* every message is applied and broadcast as soon as it arrives.
+* Without threads, a timerfd drives the ticks on Linux, and elsewhere we poll
+* the clock; each worker thread times its own ticks.
+*/
+#define MAX_PENDING_KEYS 256
+struct pendingKey {
+    game_t* game;
+    addr_t from;
+    char keystroke[8];
 };
 
-static struct gameData game; //global variable for game data
+static struct tickData {
+    double length;          // seconds per tick, 0 if not in tick mode
+    double next;            // time the next tick is due, if timerFd < 0
+    int timerFd;            // periodic timerfd driving the ticks, or -1
+} tick;
+
+/* Periodic stats lines (--stats secs): what happened since the last line.
+* Like ticks, a timerfd drives them on Linux, and elsewhere we poll the clock.
+*/
+static struct statsData {
+    double length;          // seconds between lines, 0 for none
+    double next;            // time the next line is due, if timerFd < 0
+    int timerFd;            // periodic timerfd driving the lines, or -1
+    metrics_t last;         // totals at the last line
+} stats;
+
+static _Thread_local struct pendingKeys {
+    int count;
+    struct pendingKey keys[MAX_PENDING_KEYS];
+} pending;
 
 /***************** main *******************************/
 int 
 main (const int argc, char* argv[])
 {
     // parse arguments
-    char* mapFileName = NULL;
+    char** mapFileNames = NULL;
+    int numMaps = 0;
     int seed = 0;
-    parseArgs(argc, argv, &mapFileName, &seed);
+    int tickMs = 0;
+    int numThreads = 0;
+    int statsSecs = 0;
+    parseArgs(argc, argv, &mapFileNames, &numMaps, &seed, &tickMs, &numThreads, &statsSecs);
+    metrics_init();
 
     if (seed == -1) {
-        srand(getpid());
-    }
-    else {
-        srand(seed);
+        seed = getpid();
     }
 
-    printf("%s %d\n", mapFileName, seed);
-
-    // get number of rows and columns in map
-    FILE* fp = fopen(mapFileName, "r");
-    int numCol = 0; // number of columns
-    bool addCol = true;
-    int numRow = 0; // number of rows
-    for (char c = getc(fp); c != EOF; c = getc(fp)) {
-        if (c == '\n') { // increment row count if character is newline
-            numRow = numRow + 1;
-            addCol = false;
-        }
-        if (addCol) { // increment columns if still on first row
-            numCol = numCol + 1;
+    //one game per map, each with its own seed, shared out among the workers
+    for (int i = 0; i < numMaps; i++) {
+        game_t* game = gameNew(mapFileNames[i], seed + i);
+        if (game == NULL) {
+            fprintf(stderr, "Error: mapFileName %s is invalid.\n", mapFileNames[i]);
+            exit(2);
         }
+        game->owner = (numThreads > 0) ? i % numThreads : 0;
+        server.games[server.numGames++] = game;
     }
-    printf("%d %d\n", numCol, numRow);
-    fclose(fp);
-
-    //initalize grid using map file and array of players
-
-    grid_t* gameMap = grid_new(numCol, numRow); //get row and column size
-    grid_load(gameMap, mapFileName);
-    game.map = gameMap;
-    //game.allPlayers = mem_calloc(26, sizeof(player_t));
-    //game.spect = NULL;
-    game.hasSpect = false;
-    game.numPlayers = 0;
-    game.numGold = 250;
-    game.numRows = numRow;
-    game.numCols = numCol;
-    dropGold();
+    mem_free(mapFileNames);
+    routing.games = addrtable_new(64);
 
     // initialize the message module (without logging)
-    int myPort = message_init(NULL);
+    int myPort = message_initWith(NULL, message_EPOLL);
     if (myPort == 0) {
         return 2; // failure to initialize message module
     } else {
         printf("serverPort=%d\n", myPort);
     }
 
+    // stats lines, if asked for, from now on
+    stats.timerFd = -1;
+    if (statsSecs > 0) {
+        stats.length = statsSecs;
+        stats.next = now() + stats.length;
+        stats.timerFd = startTimer(stats.length, handleStatsTimer);
+    }
+
     // Loop, waiting for input or for messages; provide callback functions.
-    bool ok = message_loop(NULL, 0, NULL, NULL, handleMessage);
+    bool ok;
+    tick.timerFd = -1;
+    if (tickMs > 0) {
+        tick.length = tickMs / 1000.0;
+    }
+    if (numThreads > 0) {
+        startWorkers(numThreads);
+        ok = message_loop(NULL, 0, NULL, NULL, handleMessage);
+        stopWorkers();
+    } else if (tickMs > 0 && (tick.timerFd = startTimer(tick.length, handleTimer)) >= 0) {
+        ok = message_loop(NULL, 0, NULL, NULL, handleMessage);
+        close(tick.timerFd);
+    } else if (tickMs > 0) {
+        // wake at least twice per tick, so an idle server runs a due tick late by at most half a tick
+        tick.next = now() + tick.length;
+        ok = message_loop(NULL, tick.length / 2, handleTimeout, NULL, handleMessage);
+    } else {
+        ok = message_loop(NULL, 0, NULL, NULL, handleMessage);
+    }
+    if (stats.timerFd >= 0) {
+        close(stats.timerFd);
+    }
 
     // shut down the message module
     message_done();
 
-    // clear memory for grid and players
-    grid_delete(gameMap);
-    for(int i = 0; i<game.numPlayers; i++){
-        player_delete(game.allPlayers[i]);
+    // clear memory for every game
+    for (int i = 0; i < server.numGames; i++) {
+        gameDelete(server.games[i]);
     }
-    //mem_free(game);
+    addrtable_delete(routing.games);
 
     return ok? 0 : 1; // status code depends on result of message_loop
 }
@@ -125,125 +346,808 @@ main (const int argc, char* argv[])
 //**************** parseArgs ****************/
 /* Receive command line inputs, checks if inputs suit usage and are valid  
 * Stores inputs in variables if valid. Does not return anything.
+* Usage: ./server map.txt [map.txt ...] [seed] [--tick ms] [--threads n]
+*                 [--trace level] [--tracefile path] [--stats secs]
+* Tracing is set up here, with trace_init: to stderr unless --tracefile says otherwise.
+* *mapFileNames is a new array, which the caller frees with mem_free.
 */
 static 
-void parseArgs(const int argc, char* argv[], char** mapFileName, int* seed)
+void parseArgs(const int argc, char* argv[], char*** mapFileNames, int* numMaps, int* seed, int* tickMs, int* numThreads, int* statsSecs)
 {
-    if (argc != 2 && argc != 3) {
-        fprintf(stderr, "Error: wrong number of arguments. Must only one or two arguments: map file name and seed(optional).\n");
+    // pull out the optional flags, leaving the positional arguments
+    char* args[argc];
+    int numArgs = 0;
+    *tickMs = 0;
+    *numThreads = 0;
+    *statsSecs = 0;
+    int traceLevel = TRACE_NONE;
+    char* traceFile = NULL;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--tick") == 0) {
+            char nextchar;
+            if (i + 1 >= argc || sscanf(argv[i+1], "%d%c", tickMs, &nextchar) != 1 || *tickMs <= 0) {
+                fprintf(stderr, "Error: --tick must be followed by a positive number of milliseconds.\n");
+                exit(4);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--threads") == 0) {
+            char nextchar;
+            if (i + 1 >= argc || sscanf(argv[i+1], "%d%c", numThreads, &nextchar) != 1 || *numThreads <= 0) {
+                fprintf(stderr, "Error: --threads must be followed by a positive number of threads.\n");
+                exit(4);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            char nextchar;
+            if (i + 1 >= argc || sscanf(argv[i+1], "%d%c", statsSecs, &nextchar) != 1 || *statsSecs <= 0) {
+                fprintf(stderr, "Error: --stats must be followed by a positive number of seconds.\n");
+                exit(4);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--trace") == 0) {
+            char nextchar;
+            if (i + 1 >= argc || sscanf(argv[i+1], "%d%c", &traceLevel, &nextchar) != 1
+                || traceLevel < TRACE_NONE || traceLevel > TRACE_FRAME) {
+                fprintf(stderr, "Error: --trace must be followed by a trace level from %d to %d.\n", TRACE_NONE, TRACE_FRAME);
+                exit(4);
+            }
+            if (traceLevel > TRACE_LEVEL) {
+                fprintf(stderr, "Warning: only trace levels up to %d are compiled in; build with TRACE_LEVEL=%d for more.\n",
+                        TRACE_LEVEL, traceLevel);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--tracefile") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --tracefile must be followed by a file name.\n");
+                exit(4);
+            }
+            traceFile = argv[++i];
+        }
+        else {
+            args[numArgs++] = argv[i];
+        }
+    }
+    if (traceLevel > TRACE_NONE) {
+        FILE* traceFP = (traceFile == NULL) ? stderr : fopen(traceFile, "w");
+        if (traceFP == NULL) {
+            fprintf(stderr, "Error: cannot write trace file %s.\n", traceFile);
+            exit(4);
+        }
+        trace_init(traceFP, traceLevel);
+    }
+
+    if (numArgs < 2) {
+        fprintf(stderr, "Error: wrong number of arguments. Must give one or more map file names and seed(optional).\n");
         exit(1);
     }
 
-    // check if map file is valid
-    *mapFileName = argv[1];
-    FILE* fp = fopen(*mapFileName, "r");
-    if (fp != NULL) { 
-        fclose(fp);
+    // a last argument that is an integer is the seed
+    char nextchar;
+    if (numArgs > 2 && sscanf(args[numArgs - 1], "%d%c", seed, &nextchar) == 1) {
+        numArgs--;
     }
     else {
-        fprintf(stderr, "Error: mapFileName is invalid.\n");
-        exit(2);
+        *seed = -1;
     }
 
-    // check if seed is valid
-    if (argc == 3) {
-        char* seedInput = argv[2];
+    if (numArgs - 1 > MAX_GAMES) {
+        fprintf(stderr, "Error: at most %d maps.\n", MAX_GAMES);
+        exit(1);
+    }
 
-        //convert seed to int using scanf
-        char nextchar;
-        if (sscanf(seedInput, "%d%c", seed, &nextchar) != 1) {
-            fprintf(stderr, "seed is not an a valid integer.\n");
-            exit(3);
+    // check if map files are valid
+    *numMaps = numArgs - 1;
+    *mapFileNames = mem_malloc(*numMaps * sizeof(char*));
+    for (int i = 0; i < *numMaps; i++) {
+        (*mapFileNames)[i] = args[i + 1];
+        FILE* fp = fopen(args[i + 1], "r");
+        if (fp != NULL) { 
+            fclose(fp);
+        }
+        else {
+            fprintf(stderr, "Error: mapFileName %s is invalid.\n", args[i + 1]);
+            exit(2);
         }
     }
-    else {
-        *seed = -1;
+}
+
+/**************** gameNew ****************/
+/* Loads a map and sets up a new game on it, with gold dropped.
+* The seed drives all of this game's random choices.
+* Returns NULL if the map cannot be loaded or has no room cells.
+*/
+static game_t*
+gameNew(const char* mapFileName, const int seed)
+{
+    game_t* game = mem_calloc_assert(1, sizeof(game_t), "gameNew");
+    game->rng = seed;
+
+    //initalize grid using map file and array of players
+    grid_t* gameMap = grid_new();
+    if (!grid_load(gameMap, (char*) mapFileName)) {
+        grid_delete(gameMap);
+        mem_free(game);
+        return NULL;
     }
+    int numRoomCells;
+    grid_getRoomCells(gameMap, &numRoomCells);
+    if (numRoomCells == 0) {
+        fprintf(stderr, "Map file %s has no room cells\n", mapFileName);
+        grid_delete(gameMap);
+        mem_free(game);
+        return NULL;
+    }
+
+    // precompute visibility, cached next to the map file
+    char* visCachePath = mem_malloc(strlen(mapFileName) + strlen(".vis") + 1);
+    sprintf(visCachePath, "%s.vis", mapFileName);
+    grid_buildVisibility(gameMap, visCachePath);
+    mem_free(visCachePath);
+
+    game->map = gameMap;
+    game->playerIndex = addrtable_new(26);
+    game->hasSpect = false;
+    game->numPlayers = 0;
+    game->numGold = 250;
+    game->numRows = grid_get_NR(gameMap);
+    game->numCols = grid_get_NC(gameMap);
+    // a run is at most as long as the longer side of the map
+    int longestRun = (game->numRows > game->numCols) ? game->numRows : game->numCols;
+    game->sprintPath = mem_malloc_assert(longestRun * sizeof(int), "gameNew");
+    atomic_init(&game->over, false);
+    TRACE(TRACE_INFO, "server", "game", "map=%s seed=%d rows=%d cols=%d", mapFileName, seed, game->numRows, game->numCols);
+    dropGold(game);
+
+    return game;
+}
+
+/**************** gameDelete ****************/
+/* Frees a game, its map, players and frame states.
+*/
+static void
+gameDelete(game_t* game)
+{
+    grid_delete(game->map);
+    for(int i = 0; i<game->numPlayers; i++){
+        player_delete(game->allPlayers[i]);
+        freeFrameState(&game->frames[i]);
+    }
+    freeFrameState(&game->spectFrame);
+    mem_free(game->allPlayers);
+    mem_free(game->frames);
+    addrtable_delete(game->playerIndex);
+    mem_free(game->sprintPath);
+    mem_free(game);
+}
+
+/**************** findGame ****************/
+/* Returns the game, not yet over, that the client at the given address
+* joined, or NULL if there is none.
+*/
+static game_t*
+findGame(addr_t from)
+{
+    int g = addrtable_find(routing.games, from);
+    if (g < 0 || atomic_load(&server.games[g]->over)) {
+        return NULL;
+    }
+    return server.games[g];
+}
+
+/**************** leastFullGame ****************/
+/* Returns the game, not yet over, that the fewest clients have joined,
+* or NULL if every game is over.
+*/
+static game_t*
+leastFullGame()
+{
+    int best = -1;
+    for (int g = 0; g < server.numGames; g++) {
+        if (!atomic_load(&server.games[g]->over) && (best < 0 || routing.joined[g] < routing.joined[best])) {
+            best = g;
+        }
+    }
+    return (best < 0) ? NULL : server.games[best];
+}
+
+/**************** addRoute ****************/
+/* Records that the client at 'from' joined 'game'; a client whose game is
+* over, and that joins again, is moved to the new game.
+*/
+static void
+addRoute(addr_t from, game_t* game)
+{
+    for (int g = 0; g < server.numGames; g++) {
+        if (server.games[g] == game) {
+            routing.joined[g]++;
+            addrtable_insert(routing.games, from, g);
+        }
+    }
+}
+
+/**************** finishGames ****************/
+/* Ends every game of this owner whose gold is all collected.
+* Returns the number of games it ended.
+*/
+static int
+finishGames(int owner)
+{
+    int ended = 0;
+    for (int g = 0; g < server.numGames; g++) {
+        game_t* game = server.games[g];
+        if (game->owner == owner && !atomic_load(&game->over) && game->numGold == 0) {
+            gameOver(game);
+            atomic_store(&game->over, true);
+            ended++;
+        }
+    }
+    return ended;
+}
+
+/**************** allGamesOver ****************/
+/* Returns true if every game is over, so the server can exit.
+*/
+static bool
+allGamesOver()
+{
+    for (int g = 0; g < server.numGames; g++) {
+        if (!atomic_load(&server.games[g]->over)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 /**************** handleMessage ****************/
 /* Datagram received; print it, parse it. and call appropriate methods.
 * Send "malformed message" if message is invalid
+* Finds the sender's game, and handles the message on it, or passes it
+* to the worker that owns the game.
 * We ignore 'arg' here.
 */
 static bool
 handleMessage(void* arg, const addr_t from, const char* message)
 {    
-    // print the message and a prompt
-    printf("'%s'\n", message);
-    printf("> ");
-    fflush(stdout);
+    uint64_t start = metrics_start();
+    TRACE(TRACE_MSG, "server", "recv", "from=%s msg='%s'", message_stringAddr(from), message);
+
+    //without a timer, stats lines are written when a message finds one due
+    if (stats.length > 0 && stats.timerFd < 0 && now() >= stats.next) {
+        handleStatsTimer(NULL, -1);
+    }
+
+    //admin query, not for any game
+    if (strcmp(message, "STATS") == 0) {
+        metrics_received(METRICS_STATS);
+        handleStats(from);
+        return false;
+    }
+
+    //"GAME n " before PLAY or SPECTATE picks the game to join
+    game_t* chosen = NULL;
+    if (strncmp(message, "GAME ", strlen("GAME ")) == 0) {
+        int gameNum = -1;
+        int length = 0;
+        sscanf(message, "GAME %d %n", &gameNum, &length);
+        if (length == 0 || gameNum < 0 || gameNum >= server.numGames || atomic_load(&server.games[gameNum]->over)) {
+            message_send(from, "QUIT Sorry - there is no such game.");
+            return false;
+        }
+        chosen = server.games[gameNum];
+        message += length;
+    }
+
+    game_t* game = NULL;
+    if (strncmp(message, "PLAY ", strlen("PLAY ")) == 0
+        || strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0) {
+        metrics_received(message[0] == 'P' ? METRICS_PLAY : METRICS_SPECTATE);
+        //a client stays in its game until the game is over, so joining again
+        //can't leave its player behind in another game; addPlayer refuses it
+        game = findGame(from);
+        if (game == NULL) {
+            game = (chosen != NULL) ? chosen : leastFullGame();
+            if (game == NULL) {
+                return true;    // every game is over
+            }
+            addRoute(from, game);
+        }
+    }
+    else if (strncmp(message, "KEY ", strlen("KEY ")) == 0
+             || strcmp(message, "DELTA") == 0 || strcmp(message, "RESYNC") == 0 || strcmp(message, "RLE") == 0) {
+        metrics_received(message[0] == 'K' ? METRICS_KEYSTROKE : (message[0] == 'D' ? METRICS_DELTA
+                         : (message[1] == 'E' ? METRICS_RESYNC : METRICS_RLE)));
+        game = findGame(from);
+        if (game == NULL) {
+            fprintf(stderr, "ERROR: message from client %s not in a game\n", message_stringAddr(from));
+            return false;
+        }
+    }
+    else {
+        metrics_received(METRICS_MALFORMED);
+        fprintf(stderr, "ERROR: malformed message");
+        message_send(from, "ERROR malformed message\n");
+        return false;
+    }
+
+    if (pool.count > 0) {
+        //pass it to the game's owner
+        postMessage(game->owner, from, game, message);
+        metrics_phase(METRICS_PARSE, start);
+        return false;
+    }
+
+    metrics_phase(METRICS_PARSE, start);
+    gameMessage(game, from, message);
 
+    //in tick mode, frames wait for the tick; without a timer, a steady stream
+    //of messages keeps select from timing out, so check whether one is due here
+    if (tick.length > 0) {
+        return (tick.timerFd < 0 && now() >= tick.next) ? handleTimer(NULL, -1) : false;
+    }
+
+    sendUpdates(0);
+    finishGames(0);
+    return allGamesOver();
+}
+
+/**************** gameMessage ****************/
+/* Handles one message from a client of 'game': PLAY, SPECTATE, KEY,
+* DELTA, RESYNC or RLE, without the GAME prefix.
+* Frames go out later, from sendUpdates.
+*/
+static void
+gameMessage(game_t* game, addr_t from, const char* message)
+{
     if (strncmp(message, "PLAY ", strlen("PLAY ")) == 0) {
         const char* playerName = message + strlen("PLAY ");
-        addPlayer(from, playerName);
-        printf("PLAY: %s\n", playerName);
+        addPlayer(game, from, playerName);
     } 
     else if (strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0) {
-        addSpectator(from);
-        printf("SPECTATE\n");
+        addSpectator(game, from);
+        TRACE(TRACE_INFO, "server", "spectate", "players=%d", game->numPlayers);
     }
     else if (strncmp(message, "KEY ", strlen("KEY ")) == 0) {
         const char* keystroke = message + strlen("KEY ");
-        printf("KEY: %s\n", keystroke);
-
-        if(!message_eqAddr(from, game.spect)) {
-            //get moving player
-            player_t* mover = NULL;
-            for(int i = 0; i<game.numPlayers; i++) {
-                if (message_eqAddr(from, player_get_addr(game.allPlayers[i]))) {
-                    mover = game.allPlayers[i];
-                }
-            }
 
-            //move player on master grid
-            handleKey(mover, keystroke);
-
-            //update player visibility
-            player_playerVisibility(mover, game.map);
+        if (tick.length == 0) {
+            handleKeyMessage(game, from, keystroke);
+        }
+        else if (pending.count < MAX_PENDING_KEYS) {
+            //apply it with the rest of this tick's keys
+            struct pendingKey* pk = &pending.keys[pending.count++];
+            pk->game = game;
+            pk->from = from;
+            snprintf(pk->keystroke, sizeof(pk->keystroke), "%s", keystroke);
         }
         else {
-            //spectator can only quit
-            if (strcmp(keystroke, "Q") == 0) {
-                player_t* playerSpect = player_new('.', "SPECTATOR", from, game.numRows, game.numCols);
-                handleQuit(playerSpect);
-                player_delete(playerSpect);
-            }
+            fprintf(stderr, "ERROR: too many keys this tick; dropping '%s'\n", keystroke);
+        }
+    }
+    else if (strcmp(message, "DELTA") == 0) {
+        //client can apply DELTA frames; its next frame is a keyframe
+        frameState_t* fs = findFrameState(game, from);
+        if (fs != NULL) {
+            bool rle = fs->rle;
+            resetFrameState(fs);
+            fs->delta = true;
+            fs->rle = rle;
+        }
+    }
+    else if (strcmp(message, "RLE") == 0) {
+        //client can decode run-length encoded full frames
+        frameState_t* fs = findFrameState(game, from);
+        if (fs != NULL) {
+            fs->rle = true;
         }
     }
+    else if (strcmp(message, "RESYNC") == 0) {
+        //client missed a frame; drop our copy so the next one is a keyframe
+        frameState_t* fs = findFrameState(game, from);
+        if (fs != NULL) {
+            fs->last = NULL;
+            fs->dirty = true;
+        }
+    }
+}
+
+/**************** handleKeyMessage ****************/
+/* Applies a keystroke from the client at 'from': moves a player,
+* or lets the spectator quit.
+*/
+static void
+handleKeyMessage(game_t* game, addr_t from, const char* keystroke)
+{
+    if (game->numGold == 0) {
+        //this game just ended
+        return;
+    }
+
+    if(!(game->hasSpect && message_eqAddr(from, game->spect))) {
+        //get moving player
+        int index = addrtable_find(game->playerIndex, from);
+        if (index < 0) {
+            //joined, but was turned away or has quit
+            return;
+        }
+        player_t* mover = game->allPlayers[index];
+
+        //move player on master grid
+        uint64_t start = metrics_start();
+        handleKey(game, mover, keystroke);
+        metrics_phase(METRICS_KEY, start);
+
+        //update player visibility
+        start = metrics_start();
+        player_updateVisibility(mover, game->map);
+        metrics_phase(METRICS_VISIBILITY, start);
+    }
     else {
-        fprintf(stderr, "ERROR: malformed message");
-        message_send(from, "ERROR malformed message\n");
+        //spectator can only quit
+        if (strcmp(keystroke, "Q") == 0) {
+            player_t* playerSpect = player_new('.', "SPECTATOR", from, game->numRows, game->numCols);
+            handleQuit(game, playerSpect);
+            player_delete(playerSpect);
+        }
     }
+}
 
-    updatePlayers();
-    updateSpectator();
+/**************** handleTimeout ****************/
+/* Called by message_loop when no message arrived for half a tick.
+* Runs the tick if it is due.
+*/
+static bool
+handleTimeout(void* arg)
+{
+    return (now() >= tick.next) ? handleTimer(NULL, -1) : false;
+}
+
+/**************** handleTimer ****************/
+/* Called by message_loop when the tick timer fires, or by handleTimeout
+* and handleMessage with fd -1 when a tick is due. Runs the tick.
+* Returns true if every game is over.
+*/
+static bool
+handleTimer(void* arg, int fd)
+{
+    uint64_t expirations;
+    if (fd >= 0 && read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return false;
+    }
+    //ticks missed while busy are not made up; one tick covers them all
+    runTick(0);
+    tick.next = now() + tick.length;
+    finishGames(0);
+    return allGamesOver();
+}
 
-    if (game.numGold == 0) {
-        gameOver();
-        return true;
+/**************** handleGameOver ****************/
+/* Called by message_loop when a worker says one of its games ended.
+* Returns true if every game is over.
+*/
+static bool
+handleGameOver(void* arg, int fd)
+{
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0) {
     }
+    return allGamesOver();
+}
 
+/**************** handleStatsTimer ****************/
+/* Called by message_loop when the stats timer fires, or by handleMessage
+* with fd -1 when a stats line is due. Writes one line to stderr of what
+* happened since the last one.
+*/
+static bool
+handleStatsTimer(void* arg, int fd)
+{
+    uint64_t expirations;
+    if (fd >= 0 && read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return false;
+    }
+    metrics_t totals;
+    metrics_read(&totals);
+    char line[1024];
+    metrics_format(&totals, &stats.last, " | ", line, sizeof(line));
+    fprintf(stderr, "stats %s\n", line);
+    stats.last = totals;
+    stats.next = now() + stats.length;
     return false;
 }
 
+/**************** handleStats ****************/
+/* Answers a STATS query, if it comes from this machine: first one message
+* with the totals since the server started, then, from the thread that owns
+* each game, one message per game with the bytes sent to each of its clients.
+*/
+static void
+handleStats(addr_t from)
+{
+    if (!message_isLocal(from)) {
+        message_send(from, "ERROR STATS is only answered on the server's own machine");
+        return;
+    }
+
+    metrics_t totals;
+    metrics_read(&totals);
+    char reply[1024];
+    int length = sprintf(reply, "STATS\n");
+    metrics_format(&totals, NULL, "\n", reply + length, sizeof(reply) - length);
+    message_send(from, reply);
+
+    if (pool.count == 0) {
+        sendClientStats(0, from);
+    }
+    for (int w = 0; w < pool.count; w++) {
+        postMessage(w, from, NULL, "STATS");
+    }
+}
+
+/**************** sendClientStats ****************/
+/* Sends 'to' one message for each of the owner's games:
+*   STATS game <g> players=<n> over=<0|1>
+*   <letter> bytes=<n> messages=<n> seen=<n> <name>
+*   ...
+*   spectator bytes=<n> messages=<n>
+* counting the GOLD and frame messages sent to each client since it joined,
+* and the map cells each player has seen.
+*/
+static void
+sendClientStats(int owner, addr_t to)
+{
+    for (int g = 0; g < server.numGames; g++) {
+        game_t* game = server.games[g];
+        if (game->owner != owner) {
+            continue;
+        }
+        //a name is at most 50 characters; three counts fit in the rest
+        const int lineLength = 140;
+        char* reply = mem_malloc_assert((game->numPlayers + 2) * lineLength, "sendClientStats");
+        int length = sprintf(reply, "STATS game %d players=%d over=%d\n", g, game->numPlayers, atomic_load(&game->over) ? 1 : 0);
+        for (int i = 0; i < game->numPlayers; i++) {
+            player_t* player = game->allPlayers[i];
+            length += sprintf(reply + length, "%c bytes=%ld messages=%ld seen=%d %s\n", player_get_c(player),
+                              game->frames[i].bytesSent, game->frames[i].messagesSent,
+                              player_countSeen(player), player_get_name(player));
+        }
+        if (game->hasSpect) {
+            sprintf(reply + length, "spectator bytes=%ld messages=%ld\n",
+                    game->spectFrame.bytesSent, game->spectFrame.messagesSent);
+        }
+        message_send(to, reply);
+        mem_free(reply);
+    }
+}
+
+/**************** startTimer ****************/
+/* Starts a periodic timer firing every 'seconds', watched by message_loop,
+* which calls 'handler' each time.
+* Returns its fd, or -1 if there is no timerfd, so the caller polls the clock.
+*/
+static int
+startTimer(double seconds, bool (*handler)(void* arg, int fd))
+{
+#ifdef __linux__
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (fd < 0) {
+        return -1;
+    }
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = (time_t) seconds;
+    spec.it_interval.tv_nsec = (long) ((seconds - (time_t) seconds) * 1e9);
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(fd, 0, &spec, NULL) < 0 || !message_addFd(fd, handler)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+/**************** runTick ****************/
+/* Applies every keystroke queued by this thread since the last tick, in
+* arrival order, then sends one frame to each client, in the owner's games,
+* whose view changed.
+*/
+static void
+runTick(int owner)
+{
+    for (int i = 0; i < pending.count; i++) {
+        handleKeyMessage(pending.keys[i].game, pending.keys[i].from, pending.keys[i].keystroke);
+    }
+    pending.count = 0;
+
+    sendUpdates(owner);
+}
+
+/**************** startWorkers ****************/
+/* Starts 'count' worker threads, and watches for games they end.
+*/
+static void
+startWorkers(int count)
+{
+    if (pipe(pool.doneFds) < 0) {
+        perror("pipe");
+        exit(5);
+    }
+    fcntl(pool.doneFds[0], F_SETFL, O_NONBLOCK);
+    message_addFd(pool.doneFds[0], handleGameOver);
+
+    pool.workers = mem_calloc_assert(count, sizeof(worker_t), "startWorkers");
+    pool.count = count;
+    for (int w = 0; w < count; w++) {
+        worker_t* worker = &pool.workers[w];
+        atomic_init(&worker->head, 0);
+        atomic_init(&worker->tail, 0);
+        atomic_init(&worker->stop, false);
+        if (pipe(worker->wakeFds) < 0) {
+            perror("pipe");
+            exit(5);
+        }
+        fcntl(worker->wakeFds[0], F_SETFL, O_NONBLOCK);
+        fcntl(worker->wakeFds[1], F_SETFL, O_NONBLOCK);
+        if (pthread_create(&worker->thread, NULL, workerMain, worker) != 0) {
+            fprintf(stderr, "Error: cannot start worker thread %d.\n", w);
+            exit(5);
+        }
+    }
+}
+
+/**************** stopWorkers ****************/
+/* Stops every worker thread and waits for it to finish.
+*/
+static void
+stopWorkers()
+{
+    for (int w = 0; w < pool.count; w++) {
+        worker_t* worker = &pool.workers[w];
+        atomic_store(&worker->stop, true);
+        if (write(worker->wakeFds[1], "", 1) < 0) {
+            //pipe full: the worker wakes up anyway
+        }
+        pthread_join(worker->thread, NULL);
+        close(worker->wakeFds[0]);
+        close(worker->wakeFds[1]);
+
+        //messages that arrived too late to handle
+        unsigned int tail = atomic_load(&worker->tail);
+        for (unsigned int h = atomic_load(&worker->head); h != tail; h++) {
+            mem_free(worker->queue[h % QUEUE_SIZE].message);
+        }
+    }
+    message_removeFd(pool.doneFds[0]);
+    close(pool.doneFds[0]);
+    close(pool.doneFds[1]);
+    mem_free(pool.workers);
+    pool.count = 0;
+}
+
+/**************** postMessage ****************/
+/* Passes a message from the main thread to the worker 'owner', for 'game';
+* a NULL game means the message is for the worker itself. The message is
+* dropped if the worker's queue is full.
+*/
+static void
+postMessage(int owner, addr_t from, game_t* game, const char* message)
+{
+    worker_t* worker = &pool.workers[owner];
+    unsigned int tail = atomic_load_explicit(&worker->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&worker->head, memory_order_acquire);
+    if (tail - head == QUEUE_SIZE) {
+        fprintf(stderr, "ERROR: worker %d is behind; dropping '%s'\n", owner, message);
+        return;
+    }
+    inbound_t* in = &worker->queue[tail % QUEUE_SIZE];
+    in->from = from;
+    in->game = game;
+    in->message = mem_malloc_assert(strlen(message) + 1, "postMessage");
+    strcpy(in->message, message);
+    atomic_store_explicit(&worker->tail, tail + 1, memory_order_release);
+    if (write(worker->wakeFds[1], "", 1) < 0) {
+        //pipe full: the worker has wakeups pending already
+    }
+}
+
+
+/**************** workerMain ****************/
+/* A worker thread: waits for messages to its games, and handles each batch
+* of them with one round of frames afterwards (or, in tick mode, one round
+* per tick). Tells the main thread when one of its games ends.
+*/
+static void*
+workerMain(void* arg)
+{
+    worker_t* worker = arg;
+    int owner = worker - pool.workers;
+    double nextTick = now() + tick.length;
+    struct pollfd wake = { .fd = worker->wakeFds[0], .events = POLLIN };
+
+    while (!atomic_load(&worker->stop)) {
+        //sleep until woken, or until the next tick is due
+        int timeoutMs = -1;
+        if (tick.length > 0) {
+            double wait = nextTick - now();
+            timeoutMs = (wait > 0) ? (int) (wait * 1000) + 1 : 0;
+        }
+        if (poll(&wake, 1, timeoutMs) > 0) {
+            char buf[256];
+            while (read(worker->wakeFds[0], buf, sizeof(buf)) > 0) {
+            }
+        }
+
+        //handle every message queued so far
+        unsigned int head = atomic_load_explicit(&worker->head, memory_order_relaxed);
+        unsigned int tail = atomic_load_explicit(&worker->tail, memory_order_acquire);
+        for (; head != tail; head++) {
+            inbound_t* in = &worker->queue[head % QUEUE_SIZE];
+            if (in->game == NULL) {
+                //STATS: the clients of this worker's games
+                sendClientStats(owner, in->from);
+            } else {
+                gameMessage(in->game, in->from, in->message);
+            }
+            mem_free(in->message);
+        }
+        atomic_store_explicit(&worker->head, head, memory_order_release);
+
+        if (tick.length == 0) {
+            sendUpdates(owner);
+        } else if (now() >= nextTick) {
+            runTick(owner);
+            nextTick = now() + tick.length;
+        }
+
+        if (finishGames(owner) > 0 && write(pool.doneFds[1], "", 1) < 0) {
+            fprintf(stderr, "ERROR: worker %d cannot report game over\n", owner);
+        }
+    }
+    return NULL;
+}
+
+/**************** now ****************/
+/* Returns the current time in seconds, from a monotonic clock.
+*/
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /**************** addPlayer ****************/
 /* Recieves an address and player name
 * Create a new player using the address, name and character based on number of players.
-* Adds new player to the game's player array
+* Adds new player to the game's player array, growing it if needed
 * Drops player in random spot in the map
+* Refuses an address that is already a player or the spectator here
 */
 
 static void
-addPlayer(addr_t from, const char* name)
+addPlayer(game_t* game, addr_t from, const char* name)
 {
-    printf("name: %s\n", name);
+    const int maxPlayers = MAX_PLAYERS;
 
-    const int maxPlayers = 26;
+    int numFree;
+    grid_getFreeCells(game->map, &numFree);
 
-    if (game.numPlayers == maxPlayers-1) {
+    if (addrtable_find(game->playerIndex, from) >= 0
+        || (game->hasSpect && message_eqAddr(from, game->spect))) {
+        //already in this game; a second player would hold a cell forever
+        message_send(from, "ERROR you have already joined this game\n");
+    }
+    else if (game->numPlayers >= maxPlayers) {
         message_send(from, "QUIT Game is full: no more players can join.");
     }
+    else if (numFree == 0) {
+        message_send(from, "QUIT Game is full: no room left on the map.");
+    }
     else if (name == NULL) {
         message_send(from, "QUIT Sorry - you must provide player's name.");
     }
@@ -260,67 +1164,93 @@ addPlayer(addr_t from, const char* name)
         }
 
         //get player letter
-        int curNumPlayers = game.numPlayers;
-        char playerLetter = 'A' + curNumPlayers;
+        int curNumPlayers = game->numPlayers;
+        char letter = playerLetter(curNumPlayers);
 
         //create new player
-        player_t* newPlayer = player_new(playerLetter, newName, from, game.numRows, game.numCols);
+        player_t* newPlayer = player_new(letter, newName, from, game->numRows, game->numCols);
         
         if (newPlayer != NULL) {
-            game.allPlayers[game.numPlayers] = newPlayer;   
-            game.numPlayers++;
+            if (game->numPlayers == game->playerSlots) {
+                //double the player registry
+                int slots = (game->playerSlots == 0) ? 32 : game->playerSlots * 2;
+                player_t** players = mem_malloc_assert(slots * sizeof(player_t*), "addPlayer");
+                frameState_t* frames = mem_calloc_assert(slots, sizeof(frameState_t), "addPlayer");
+                if (game->numPlayers > 0) {
+                    memcpy(players, game->allPlayers, game->numPlayers * sizeof(player_t*));
+                    memcpy(frames, game->frames, game->numPlayers * sizeof(frameState_t));
+                }
+                mem_free(game->allPlayers);
+                mem_free(game->frames);
+                game->allPlayers = players;
+                game->frames = frames;
+                game->playerSlots = slots;
+            }
+            game->allPlayers[game->numPlayers] = newPlayer;   
+            resetFrameState(&game->frames[game->numPlayers]);
+            addrtable_insert(game->playerIndex, from, game->numPlayers);
+            game->numPlayers++;
+            TRACE(TRACE_INFO, "server", "join", "id=%d letter=%c name='%s'", curNumPlayers, letter, newName);
 
             //send OK message to client
             char okMsg[10];
-            sprintf(okMsg, "OK %c\n", playerLetter);
+            sprintf(okMsg, "OK %c\n", letter);
             message_send(from, okMsg);  
 
             //send GRID message to client   
             char gridMsg[100];
-            sprintf(gridMsg, "GRID %d %d\n", game.numRows, game.numCols);
+            sprintf(gridMsg, "GRID %d %d\n", game->numRows, game->numCols);
             message_send(from, gridMsg);
 
-            //drop player in randomly selected room spot in map
-            bool dropped = false;
-            while (!dropped) {
-                int x = rand() % (game.numCols);
-                int y = rand() % (game.numRows);
-
-                if(gridcell_getC(grid_get(game.map, x, y)) == '.') {
-                    grid_set(game.map, x, y, playerLetter);
-                    player_set_x(newPlayer, x);
-                    player_set_y(newPlayer, y);
-                    dropped = true;
-                }
-            }
+            //drop player in randomly selected free room spot in map
+            int spot = randomFreeCell(game);
+            int x = spot % game->numCols;
+            int y = spot / game->numCols;
+            setOccupant(game, x, y, curNumPlayers);
+            player_set_x(newPlayer, x);
+            player_set_y(newPlayer, y);
 
             //update player visibility
-            player_playerVisibility(newPlayer, game.map);
+            player_updateVisibility(newPlayer, game->map);
         }
     }
 }
 
 
+/**************** playerLetter ****************/
+/* Returns the letter that shows the player with the given index on the map.
+* Letters repeat after Z: the grid's occupant layer, not the letter, says who is where.
+*/
+static char
+playerLetter(int index)
+{
+    return grid_occupantLetter(index);
+}
+
+
 /**************** addSpectator ****************/
 /* Recieves an address for spectator client
 * Checks if there is an existing spectator. If there is, sends QUIT message to existing one
 * and replaces it.
 */
 static void
-addSpectator(addr_t from)
+addSpectator(game_t* game, addr_t from)
 {
     //if there is already a spectator, send QUIT
-    if (game.hasSpect == true) {
-        message_send(game.spect, "QUIT You have been replaced by a new spectator");
+    if (game->hasSpect == true) {
+        message_send(game->spect, "QUIT You have been replaced by a new spectator");
     }
     
     //create new spectator
-    game.spect = from;
-    game.hasSpect = true;
+    game->spect = from;
+    game->hasSpect = true;
+    resetFrameState(&game->spectFrame);
+    game->spectFrame.bytesSent = 0;
+    game->spectFrame.messagesSent = 0;
 
     //send GRID message to client   
     char gridMsg[100];
-    sprintf(gridMsg, "GRID %d %d\n", game.numRows, game.numCols);
+    sprintf(gridMsg, "GRID %d %d\n", game->numRows, game->numCols);
     message_send(from, gridMsg);
 }
 
@@ -330,75 +1260,59 @@ addSpectator(addr_t from)
 * where player is trying to move.
 */
 static void 
-handleKey(player_t* player, const char* key) 
+handleKey(game_t* game, player_t* player, const char* key) 
 {
     switch (*key) {
     case 'h': 
-        moveOnMap(player, player_get_x(player)-1, player_get_y(player));
+        moveOnMap(game, player, player_get_x(player)-1, player_get_y(player));
         break;
     case 'l': 
-        moveOnMap(player, player_get_x(player)+1, player_get_y(player));
+        moveOnMap(game, player, player_get_x(player)+1, player_get_y(player));
         break;
     case 'j': 
-        moveOnMap(player, player_get_x(player), player_get_y(player)+1);
+        moveOnMap(game, player, player_get_x(player), player_get_y(player)+1);
         break;
     case 'k': 
-        moveOnMap(player, player_get_x(player), player_get_y(player)-1);
+        moveOnMap(game, player, player_get_x(player), player_get_y(player)-1);
         break;
     case 'y': 
-        moveOnMap(player, player_get_x(player)-1, player_get_y(player)-1);
+        moveOnMap(game, player, player_get_x(player)-1, player_get_y(player)-1);
         break;
     case 'u': 
-        moveOnMap(player, player_get_x(player)+1, player_get_y(player)-1);
+        moveOnMap(game, player, player_get_x(player)+1, player_get_y(player)-1);
         break;
     case 'b': 
-        moveOnMap(player, player_get_x(player)-1, player_get_y(player)+1);
+        moveOnMap(game, player, player_get_x(player)-1, player_get_y(player)+1);
         break;
     case 'n': 
-        moveOnMap(player, player_get_x(player)+1, player_get_y(player)+1);
+        moveOnMap(game, player, player_get_x(player)+1, player_get_y(player)+1);
         break;
-     case 'H': 
-        while(moveOnMap(player, player_get_x(player)-1, player_get_y(player))){
-            player_playerVisibility(player, game.map);
-        }
+    case 'H': 
+        sprint(game, player, -1, 0);
         break;
     case 'L': 
-        while(moveOnMap(player, player_get_x(player)+1, player_get_y(player))){
-            player_playerVisibility(player, game.map);
-        }
+        sprint(game, player, 1, 0);
         break;
     case 'J': 
-        while(moveOnMap(player, player_get_x(player), player_get_y(player)+1)){
-            player_playerVisibility(player, game.map);
-        }
+        sprint(game, player, 0, 1);
         break;
     case 'K': 
-        while(moveOnMap(player, player_get_x(player), player_get_y(player)-1)){
-            player_playerVisibility(player, game.map);
-        }
+        sprint(game, player, 0, -1);
         break;
     case 'Y': 
-        while(moveOnMap(player, player_get_x(player)-1, player_get_y(player)-1)){
-            player_playerVisibility(player, game.map);
-        }
+        sprint(game, player, -1, -1);
         break;
     case 'U': 
-        while(moveOnMap(player, player_get_x(player)+1, player_get_y(player)-1)){
-            player_playerVisibility(player, game.map);
-        }
+        sprint(game, player, 1, -1);
         break;
     case 'B': 
-        while(moveOnMap(player, player_get_x(player)-1, player_get_y(player)+1)){
-            player_playerVisibility(player, game.map);
-        }
+        sprint(game, player, -1, 1);
         break;
     case 'N': 
-        while(moveOnMap(player, player_get_x(player)+1, player_get_y(player)+1)){
-            player_playerVisibility(player, game.map);
-        }
+        sprint(game, player, 1, 1);
         break;
     case 'Q':
-        handleQuit(player);
+        handleQuit(game, player);
         break;
     default:
         fprintf(stderr, "ERROR usage: unknown keystroke");
@@ -414,65 +1328,51 @@ handleKey(player_t* player, const char* key)
 * Returns true if move is successful, false if not.
 */
 static bool
-moveOnMap(player_t* player, int newX, int newY)
+moveOnMap(game_t* game, player_t* player, int newX, int newY)
 {
     if (player_is_active(player) == true) {
         int curX = player_get_x(player);
         int curY = player_get_y(player);
-        gridcell_t* curCell = grid_get(game.map, curX, curY);
-        gridcell_t* newCell = grid_get(game.map, newX, newY);
-        char curChar = gridcell_getC(curCell);
-        if(newCell == NULL || curCell == NULL) {
+        gridcell_t curCell = grid_get(game->map, curX, curY);
+        gridcell_t newCell = grid_get(game->map, newX, newY);
+        if(!gridcell_isValid(newCell) || !gridcell_isValid(curCell)) {
             return false;
         }
         else {
-            char newChar = gridcell_getC(newCell);
-            if(isupper(newChar)) { 
-                int checkLetter = newChar - 'A';
-                player_t* otherPlayer = game.allPlayers[checkLetter];
-                grid_set(game.map, curX, curY, newChar); 
+            char terrain = gridcell_getC(newCell);
+            int mover = grid_getOccupant(game->map, curX, curY);
+            int other = grid_getOccupant(game->map, newX, newY);
+            if(other >= 0) { 
+                //swap places with the other player
+                player_t* otherPlayer = game->allPlayers[other];
+                setOccupant(game, curX, curY, other); 
                 player_set_x(otherPlayer, curX);
                 player_set_y(otherPlayer, curY);
+                game->frames[other].dirty = true;
 
-                grid_set(game.map, newX, newY, curChar); 
-                player_set_x(player, newX);
-                player_set_y(player, newY);
-
-                return true;
-            }
-            else if (newChar == '*') {
-                int pileGold = gridcell_getGold(newCell);
-                int newScore = player_get_score(player) + pileGold;
-                player_set_score(player, newScore);
-                game.numGold -= pileGold;
-                grid_set(game.map, newX, newY, curChar); 
+                setOccupant(game, newX, newY, mover); 
                 player_set_x(player, newX);
                 player_set_y(player, newY);
-                if(gridcell_getRoom(curCell)) {
-                    grid_set(game.map, curX, curY, '.');
-                }
-                else {
-                    grid_set(game.map, curX, curY, '#');
-                }
-
-                //send GOLD message to player
-                char goldMsg[100];
-                sprintf(goldMsg, "GOLD %d %d %d\n", pileGold, player_get_score(player), game.numGold);
-                message_send(player_get_addr(player), goldMsg);
-                game.justFoundGold = player_get_addr(player);
 
                 return true;
             }
-            else if (newChar == '.' || newChar == '#') {
-                grid_set(game.map, newX, newY, curChar);
+            else if (terrain == '.' || terrain == '#') {
+                setOccupant(game, newX, newY, mover);
+                setOccupant(game, curX, curY, -1);
                 player_set_x(player, newX);
                 player_set_y(player, newY);
 
-                if(gridcell_getRoom(curCell)) {
-                    grid_set(game.map, curX, curY, '.');
-                }
-                else {
-                    grid_set(game.map, curX, curY, '#');
+                int pileGold = gridcell_getGold(newCell);
+                if (pileGold > 0) {
+                    //pick up the pile
+                    grid_setGold(game->map, newX, newY, 0);
+                    int newScore = player_get_score(player) + pileGold;
+                    player_set_score(player, newScore);
+                    game->numGold -= pileGold;
+                    markAllChanged(game); //everyone's GOLD line changes
+
+                    //the player hears of it with the frame that shows it
+                    game->frames[mover].goldFound += pileGold;
                 }
 
                 return true;
@@ -484,6 +1384,79 @@ moveOnMap(player_t* player, int newX, int newY)
 }
 
 
+/**************** sprint ****************/
+/* Moves a player as far as they can go in direction (dx,dy), as one operation.
+* Finds where the run stops (the last room or passage cell along the ray), then
+* walks the path once: each player in the way steps back one cell, as if swapped,
+* and every pile of gold on it is picked up and reported in the next GOLD message.
+* Finally marks everything visible from the path as seen, in one pass.
+* Ends in the same state as repeating moveOnMap one step at a time.
+*/
+static void
+sprint(game_t* game, player_t* player, int dx, int dy)
+{
+    if (!player_is_active(player)) {
+        return;
+    }
+    int numCols = game->numCols;
+    int x = player_get_x(player);
+    int y = player_get_y(player);
+    const char* terrain = grid_getChars(game->map);
+    const int* occupants = grid_getOccupants(game->map);
+    const int* gold = grid_getGold(game->map);
+
+    //find where the run stops
+    int* path = game->sprintPath;
+    int length = 0;
+    for (int nx = x+dx, ny = y+dy; nx >= 0 && ny >= 0 && nx < numCols && ny < game->numRows; nx += dx, ny += dy) {
+        char c = terrain[ny * numCols + nx];
+        if (c != '.' && c != '#') {
+            break;
+        }
+        path[length++] = ny * numCols + nx;
+    }
+    if (length == 0) {
+        return;
+    }
+
+    //walk the path: the cell behind the mover gets the player it steps onto, if any
+    int mover = occupants[y * numCols + x];
+    int behind = y * numCols + x;
+    int pileGold = 0;
+    for (int i = 0; i < length; i++) {
+        int ahead = path[i];
+        int other = occupants[ahead];
+        setOccupant(game, behind % numCols, behind / numCols, other);
+        if (other >= 0) {
+            player_set_x(game->allPlayers[other], behind % numCols);
+            player_set_y(game->allPlayers[other], behind / numCols);
+            game->frames[other].dirty = true;
+        }
+        else if (gold[ahead] > 0) {
+            pileGold += gold[ahead];
+            grid_setGold(game->map, ahead % numCols, ahead / numCols, 0);
+        }
+        behind = ahead;
+    }
+    setOccupant(game, behind % numCols, behind / numCols, mover);
+    player_set_x(player, behind % numCols);
+    player_set_y(player, behind / numCols);
+    game->frames[mover].dirty = true;
+
+    if (pileGold > 0) {
+        player_set_score(player, player_get_score(player) + pileGold);
+        game->numGold -= pileGold;
+        markAllChanged(game); //everyone's GOLD line changes
+
+        //the player hears of it with the frame that shows it
+        game->frames[mover].goldFound += pileGold;
+    }
+
+    //everything visible from the path has been seen
+    player_updatePathVisibility(player, game->map, path, length - 1);
+}
+
+
 /**************** handleQuit ****************/
 /* Recieves a player that sent quit command
 * If the player is the spectator, change the game's hasSpect boolean to false.
@@ -491,166 +1464,515 @@ moveOnMap(player_t* player, int newX, int newY)
 * client a QUIT message.
 */
 static void
-handleQuit(player_t* player) 
+handleQuit(game_t* game, player_t* player) 
 {
-    if(message_eqAddr(player_get_addr(player), game.spect)) {
-        game.hasSpect = false;
-        message_send(game.spect, "QUIT Thanks for watching!");
+    if(message_eqAddr(player_get_addr(player), game->spect)) {
+        game->hasSpect = false;
+        message_send(game->spect, "QUIT Thanks for watching!");
     }
     else {
-        //remove player's symbol from map
-        int curX = player_get_x(player);
-        int curY = player_get_y(player);
-        gridcell_t* curCell = grid_get(game.map, curX, curY);
-        if(gridcell_getRoom(curCell)) {
-            grid_set(game.map, curX, curY, '.');
-        }
-        else {
-            grid_set(game.map, curX, curY, '#');
-        }
+        //remove player from map
+        setOccupant(game, player_get_x(player), player_get_y(player), -1);
 
         player_deactivate(player);
+        addrtable_remove(game->playerIndex, player_get_addr(player));
         message_send(player_get_addr(player), "QUIT Thanks for playing!");
     }
 }
 
 
+/**************** randomFreeCell ****************/
+/* Returns the index of a random room cell with no gold and no player,
+* or -1 if there is none.
+*/
+static int
+randomFreeCell(game_t* game)
+{
+    int numFree;
+    const int* freeCells = grid_getFreeCells(game->map, &numFree);
+    if (numFree == 0) {
+        return -1;
+    }
+    return freeCells[rand_r(&game->rng) % numFree];
+}
+
+
 /**************** dropGold ****************/
 /* Drops gold at random locations of the grid. Drops a random number of piles
 * between the minimum and maximum number of piles. The numnber of gold in all the piles
-* sums up to 250.
+* sums up to 250. If the map runs out of free room cells, the rest of the gold
+* goes on the last pile, so none is lost. The map must have a room cell.
 */
 static void
-dropGold()
+dropGold(game_t* game)
 {
     const int goldTotal = 250; //amount of gold in game
     const int goldMinNumPiles = 10; //minimum number of gold piles
     const int goldMaxNumPiles = 30; //maximum number of gold piles
 
-    int numPiles = (rand() % (goldMaxNumPiles - goldMinNumPiles)) + goldMinNumPiles;
+    int numPiles = (rand_r(&game->rng) % (goldMaxNumPiles - goldMinNumPiles)) + goldMinNumPiles;
     
     int remaining = goldTotal; //remaining gold to drop
     int bound = (int) (goldTotal / numPiles);
-    int numGoldInPile = 0;
-
-    for (int i = 0; i<numPiles-1; i++) {
-        numGoldInPile = (rand() % (bound-1)) + 1;
-
-        //drop gold
-        bool dropped = false;
-        while (!dropped) {
-            int x = rand() % (game.numCols);
-            int y = rand() % (game.numRows);
-
-            char randCell = gridcell_getC(grid_get(game.map, x, y));
-            if(randCell== '.') {
-                grid_set(game.map, x, y, '*');
-                gridcell_setGold(grid_get(game.map, x, y), numGoldInPile);
-                dropped = true;
-            }
-        }
-        remaining = remaining - numGoldInPile;
-    }
+    int lastPile = -1;
 
-    bool dropped = false;
-    while (!dropped) {
-        int x = rand() % (game.numCols);
-        int y = rand() % (game.numRows);
+    for (int i = 0; i<numPiles && remaining > 0; i++) {
+        //the last pile takes whatever is left
+        int numGoldInPile = (i == numPiles-1) ? remaining : (rand_r(&game->rng) % (bound-1)) + 1;
 
-        if(gridcell_getC(grid_get(game.map, x, y)) == '.') {
-            grid_set(game.map, x, y, '*');
-            gridcell_setGold(grid_get(game.map, x, y), remaining);            
-            dropped = true;
+        int spot = randomFreeCell(game);
+        if (spot < 0) {
+            //map is full: add the rest to the last pile
+            spot = lastPile;
+            numGoldInPile = remaining;
         }
+        int x = spot % game->numCols;
+        int y = spot / game->numCols;
+        grid_setGold(game->map, x, y, grid_getGold(game->map)[spot] + numGoldInPile);
+        lastPile = spot;
+        remaining = remaining - numGoldInPile;
     }
 }
 
 
 /**************** updatePlayers ****************/
-/* Loops through players and sends GOLD and DISPLAY messages to their clients.
+/* Loops through players and sends GOLD and DISPLAY messages to the clients
+* of those whose view changed since their last frame.
 */
 static void
-updatePlayers()
+updatePlayers(game_t* game)
 {
-     for(int i = 0; i<game.numPlayers; i++) {
+     for(int i = 0; i<game->numPlayers; i++) {
         //get current player
-        player_t* curPlayer = game.allPlayers[i];
+        player_t* curPlayer = game->allPlayers[i];
         if(curPlayer == NULL){
-            printf("player is null\n");
+            fprintf(stderr, "player is null\n");
+            continue;
         }
-
-        if (!message_eqAddr(game.justFoundGold, player_get_addr(curPlayer))) {
-            //send GOLD message to players
-            char goldMsg[100];
-            int score = player_get_score(curPlayer);
-            sprintf(goldMsg, "GOLD %d %d %d\n", 0, score, game.numGold);
-            message_send(player_get_addr(curPlayer), goldMsg);
+        if (!game->frames[i].dirty) {
+            continue;
         }
-        
-        //send DISPLAY message to players
-        char* gridString = player_get_string(curPlayer, game.map);
-        char* displayMsg = mem_malloc((sizeof(char) * strlen(gridString)) + 10);
-        strcpy(displayMsg, "DISPLAY\n");
-        strcat(displayMsg, gridString);
-        message_send(player_get_addr(curPlayer), displayMsg);
-        mem_free(gridString);
-        mem_free(displayMsg);
+        game->frames[i].dirty = false;
+
+        //draw the frame first, since that sets up the client's buffers
+        char* frame = frameBuffer(game, &game->frames[i]);
+        int frameLen = player_renderString(curPlayer, game->map, frame);
+
+        //GOLD message, with any gold just found, if it changed; it goes out with the frame
+        int goldLen = goldMessage(&game->frames[i], game->frames[i].goldFound,
+                                  player_get_score(curPlayer), game->numGold);
+        game->frames[i].goldFound = 0;
+
+        //send GOLD and DISPLAY or DELTA message to players
+        sendFrame(player_get_addr(curPlayer), &game->frames[i], frameLen, goldLen);
     }
 }
 
 
 /**************** updateSpectator ****************/
-/* Sends GOLD and DISPLAY message to the spectator.
+/* Sends GOLD and DISPLAY message to the spectator, if the game changed
+* since their last frame.
 */
 static void
-updateSpectator()
+updateSpectator(game_t* game)
 {
-    if (game.hasSpect) {
-        //send GOLD message to specator
-        char goldMsg[100];
-        sprintf(goldMsg, "GOLD %d %d %d\n", 0, 0, game.numGold);
-        message_send(game.spect, goldMsg);
+    if (game->hasSpect && game->spectFrame.dirty) {
+        game->spectFrame.dirty = false;
+
+        //draw the whole map, gold and players included
+        char* frame = frameBuffer(game, &game->spectFrame);
+        int frameLen = grid_renderMap(game->map, frame);
 
-        //send DISPLAY message to spectator
-        grid_update_map(game.map);
-        char* gridString = grid_get_map(game.map);
-        char* displayMsg = mem_malloc((sizeof(char) * strlen(gridString)) + 9);
-        strcpy(displayMsg, "DISPLAY\n");
-        strcat(displayMsg, gridString);
-        message_send(game.spect, displayMsg);
-        //mem_free(gridString);
-        mem_free(displayMsg);
+        //GOLD message, if it changed; it goes out with the frame
+        int goldLen = goldMessage(&game->spectFrame, 0, 0, game->numGold);
+
+        //send GOLD and DISPLAY or DELTA message to spectator
+        sendFrame(game->spect, &game->spectFrame, frameLen, goldLen);
     }
 }
 
 
+/**************** sendUpdates ****************/
+/* Sends GOLD and frame messages to every client, in the owner's games
+* still running, whose view changed; all in one batch.
+*/
+static void
+sendUpdates(int owner)
+{
+    for (int g = 0; g < server.numGames; g++) {
+        game_t* game = server.games[g];
+        if (game->owner == owner && !atomic_load(&game->over)) {
+            uint64_t start = metrics_start();
+            updatePlayers(game);
+            updateSpectator(game);
+            metrics_phase(METRICS_RENDER, start);
+        }
+    }
+    flushOutbox();
+}
+
+
+/**************** queueMessage ****************/
+/* Queues a message, 'length' bytes, for the next flushOutbox, and counts
+* it as sent to the client of 'fs'. The message is not copied: it must stay
+* as it is until then. Every message queued is in one of the client buffers
+* of a frameState.
+*/
+static void
+queueMessage(addr_t to, frameState_t* fs, char* message, int length)
+{
+    if (outbox.count == OUTBOX_SIZE) {
+        flushOutbox();
+    }
+    outbox.to[outbox.count] = to;
+    outbox.messages[outbox.count] = message;
+    outbox.count++;
+    outbox.bytes += length;
+    fs->bytesSent += length;
+    fs->messagesSent++;
+}
+
+
+/**************** flushOutbox ****************/
+/* Sends every queued message, in the order queued.
+*/
+static void
+flushOutbox()
+{
+    if (outbox.count == 0) {
+        return;
+    }
+    uint64_t start = metrics_start();
+    message_sendBatch(outbox.to, outbox.messages, outbox.count);
+    metrics_phase(METRICS_SEND, start);
+    metrics_sent(outbox.count, outbox.bytes);
+    outbox.count = 0;
+    outbox.bytes = 0;
+}
+
+
+/**************** findFrameState ****************/
+/* Returns the frame state of the player or spectator at the given address,
+* or NULL if the address is not in the game.
+*/
+static frameState_t*
+findFrameState(game_t* game, addr_t from)
+{
+    if (game->hasSpect && message_eqAddr(from, game->spect)) {
+        return &game->spectFrame;
+    }
+    int index = addrtable_find(game->playerIndex, from);
+    return (index < 0) ? NULL : &game->frames[index];
+}
+
+
+/**************** resetFrameState ****************/
+/* Forgets the last frame sent, and goes back to plain DISPLAY frames.
+* The client is marked dirty, so it gets a new frame on the next update.
+* Keeps the buffers, for whoever uses this frame state next.
+*/
+static void
+resetFrameState(frameState_t* fs)
+{
+    fs->last = NULL;
+    fs->seq = 0;
+    fs->delta = false;
+    fs->rle = false;
+    fs->dirty = true;
+    fs->goldPurse = -1;
+    fs->goldLeft = -1;
+}
+
+
+/**************** freeFrameState ****************/
+/* Frees the buffers of a frame state, when its game is deleted.
+*/
+static void
+freeFrameState(frameState_t* fs)
+{
+    //all the buffers are one allocation, starting with goldMsg
+    if (fs->goldMsg != NULL) {
+        mem_free(fs->goldMsg);
+        fs->goldMsg = NULL;
+    }
+    fs->last = NULL;
+}
+
+
+/**************** frameBuffer ****************/
+/* Returns where to draw the next frame for a client, with FRAME_HEADER
+* bytes free in front of it. The first call allocates all the client's
+* message buffers at once, sized for this game's map.
+*/
+static char*
+frameBuffer(game_t* game, frameState_t* fs)
+{
+    if (fs->goldMsg == NULL) {
+        //one frame, rows joined with '\n', plus the '\0'
+        size_t frameSize = game->numRows * (game->numCols + 1) + 1;
+        //worst case every other cell changes, and each run costs a header;
+        //that is also room enough for a run-length encoded frame
+        size_t deltaSize = 64 + frameSize * 4;
+        const size_t goldSize = 64;
+        char* block = mem_malloc_assert(goldSize + 2 * (FRAME_HEADER + frameSize) + deltaSize, "frameBuffer");
+        fs->goldMsg = block;
+        fs->buf[0] = block + goldSize;
+        fs->buf[1] = fs->buf[0] + FRAME_HEADER + frameSize;
+        fs->deltaMsg = fs->buf[1] + FRAME_HEADER + frameSize;
+        fs->cur = 0;
+    }
+    return fs->buf[fs->cur] + FRAME_HEADER;
+}
+
+
+/**************** setOccupant ****************/
+/* Puts the player with the given id in a cell of the master grid (or, for
+* -1, empties it), and marks dirty every client whose frame shows that
+* cell: the players who have seen it, and the spectator.
+*/
+static void
+setOccupant(game_t* game, int x, int y, int id)
+{
+    grid_setOccupant(game->map, x, y, id);
+
+    int index = y * game->numCols + x;
+    for (int i = 0; i<game->numPlayers; i++) {
+        if (player_get_boolGrid(game->allPlayers[i], index)) {
+            game->frames[i].dirty = true;
+        }
+    }
+    game->spectFrame.dirty = true;
+}
+
+
+/**************** markAllChanged ****************/
+/* Marks every client dirty, e.g. when the amount of unclaimed gold changes.
+*/
+static void
+markAllChanged(game_t* game)
+{
+    for (int i = 0; i<game->numPlayers; i++) {
+        game->frames[i].dirty = true;
+    }
+    game->spectFrame.dirty = true;
+}
+
+
+/**************** goldMessage ****************/
+/* Writes "GOLD found purse left" in the client's gold buffer, unless it
+* would tell the client nothing new: no gold found, and the same purse and
+* gold left as the last one. Returns its length, or 0 if there is nothing
+* to send.
+*/
+static int
+goldMessage(frameState_t* fs, int found, int purse, int left)
+{
+    if (found == 0 && purse == fs->goldPurse && left == fs->goldLeft) {
+        return 0;
+    }
+    fs->goldPurse = purse;
+    fs->goldLeft = left;
+    return sprintf(fs->goldMsg, "GOLD %d %d %d\n", found, purse, left);
+}
+
+
+/**************** sendFrame ****************/
+/* Sends one frame to a client. Clients that have not asked for DELTA get
+* the usual "DISPLAY\n" plus the whole frame. The others get
+*   DELTA seq base
+*   row col text
+*   ...
+* with one line per run of changed cells since frame 'base'. A base of 0 marks
+* a keyframe, which is diffed against a blank screen. The client answers
+* RESYNC if 'base' is not the last frame it applied, and we send a keyframe.
+* Clients that asked for RLE get their full frames run-length encoded:
+* "DISPLAY RLE\n" instead of DISPLAY, and "DELTA seq 0 RLE\n" for keyframes.
+* The frame, frameLen bytes, is the one just drawn at frameBuffer; a DISPLAY
+* message is sent from where it lies, with the header written in front.
+* A GOLD message of goldLen bytes (see goldMessage), if any, goes just before
+* the frame, and a DELTA is sent even if no cell changed, so that the client
+* never hears of gold before it sees the frame that shows it.
+*/
+static void
+sendFrame(addr_t to, frameState_t* fs, int frameLen, int goldLen)
+{
+    char* frame = fs->buf[fs->cur] + FRAME_HEADER;
+    char* message;
+    int length;
+    if (!fs->delta && fs->rle) {
+        int headerLen = sprintf(fs->deltaMsg, "DISPLAY RLE\n");
+        message = fs->deltaMsg;
+        length = headerLen + encodeRLE(fs->deltaMsg + headerLen, frame, frameLen);
+    }
+    else if (!fs->delta) {
+        memcpy(fs->buf[fs->cur], "DISPLAY\n", FRAME_HEADER);
+        message = fs->buf[fs->cur];
+        length = FRAME_HEADER + frameLen;
+    }
+    else {
+        int base = (fs->last == NULL) ? 0 : fs->seq;
+        int headerLen;
+        int bodyLen;
+        if (base == 0 && fs->rle) {
+            headerLen = sprintf(fs->deltaMsg, "DELTA %d 0 RLE\n", fs->seq + 1);
+            bodyLen = encodeRLE(fs->deltaMsg + headerLen, frame, frameLen);
+        } else {
+            headerLen = sprintf(fs->deltaMsg, "DELTA %d %d\n", fs->seq + 1, base);
+            bodyLen = encodeDelta(fs->deltaMsg + headerLen, fs->last, frame);
+        }
+
+        //nothing changed since the last frame, and no GOLD: nothing to send
+        if (base != 0 && bodyLen == 0 && goldLen == 0) {
+            return;
+        }
+        message = fs->deltaMsg;
+        length = headerLen + bodyLen;
+
+        //this frame is now the last one
+        fs->last = frame;
+        fs->seq++;
+    }
+
+    if (goldLen > 0) {
+        queueMessage(to, fs, fs->goldMsg, goldLen);
+    }
+    queueMessage(to, fs, message, length);
+
+    //the next frame is drawn in the other buffer
+    fs->cur = 1 - fs->cur;
+}
+
+
+/**************** encodeDelta ****************/
+/* Writes one "row col text\n" line into buf for each run of cells that differ
+* between prev and frame, both rows joined with '\n'. A NULL prev stands for a
+* blank screen. Runs separated by only a few unchanged cells are merged, since
+* resending those cells is cheaper than another line header.
+* Returns the number of bytes written; buf is NUL-terminated.
+*/
+static int
+encodeDelta(char* buf, const char* prev, const char* frame)
+{
+    const int mergeGap = 4;
+    int len = 0;
+    int row = 0;
+    const char* line = frame;
+    const char* prevLine = prev;
+
+    while (*line != '\0') {
+        int width = strcspn(line, "\n");
+        int prevWidth = (prevLine == NULL) ? 0 : strcspn(prevLine, "\n");
+
+        int col = 0;
+        while (col < width) {
+            char old = (col < prevWidth) ? prevLine[col] : ' ';
+            if (line[col] == old) {
+                col++;
+                continue;
+            }
+
+            //extend the run until mergeGap unchanged cells in a row
+            int start = col;
+            int end = col + 1;
+            int same = 0;
+            for (col++; col < width && same < mergeGap; col++) {
+                old = (col < prevWidth) ? prevLine[col] : ' ';
+                if (line[col] == old) {
+                    same++;
+                } else {
+                    same = 0;
+                    end = col + 1;
+                }
+            }
+            col = end;
+            len += sprintf(buf + len, "%d %d %.*s\n", row, start, end - start, line + start);
+        }
+
+        //next row of each frame
+        line += width;
+        if (*line == '\n') {
+            line++;
+        }
+        if (prevLine != NULL) {
+            prevLine += prevWidth;
+            if (*prevLine == '\n') {
+                prevLine++;
+            }
+        }
+        row++;
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+
+/**************** encodeRLE ****************/
+/* Writes the frame, frameLen bytes, into buf with each run of RLE_MIN_RUN or
+* more of one character replaced by RLE_MARK, a count character and the
+* character; longer runs than RLE_MAX_RUN take several. A RLE_MARK in the
+* frame is written as a run of one, so buf needs 3 * frameLen + 1 bytes.
+* Returns the number of bytes written; buf is NUL-terminated.
+*/
+static int
+encodeRLE(char* buf, const char* frame, int frameLen)
+{
+    int len = 0;
+    int i = 0;
+    while (i < frameLen) {
+        char c = frame[i];
+        int run = 1;
+        while (i + run < frameLen && frame[i + run] == c && run < RLE_MAX_RUN) {
+            run++;
+        }
+        if (run >= RLE_MIN_RUN || c == RLE_MARK) {
+            buf[len++] = RLE_MARK;
+            buf[len++] = ' ' + run;
+            buf[len++] = c;
+        } else {
+            memset(buf + len, c, run);
+            len += run;
+        }
+        i += run;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+
 /**************** gameOver ****************/
 /* Creates game over message with player data and sends it to the 
 * client of every player.
 */
 static void
-gameOver() 
+gameOver(game_t* game) 
 {
-    //get game over message
-    char gameOverMsg[100];
-    sprintf(gameOverMsg, "QUIT GAME OVER:\n");
-    for (int i = 0; i<game.numPlayers; i++) {
-        player_t* curPlayer = game.allPlayers[i];
-        char playerData[50];
-        sprintf(playerData, "%-3c %7d %s\n", player_get_c(curPlayer), player_get_score(curPlayer), player_get_name(curPlayer));
-        strcat(gameOverMsg, playerData);
+    //get game over message: a line per player, each with a name of at most 50 characters
+    const int lineLength = 70;
+    char* gameOverMsg = mem_malloc_assert(strlen("QUIT GAME OVER:\n") + game->numPlayers * lineLength + 1, "gameOver");
+    int length = sprintf(gameOverMsg, "QUIT GAME OVER:\n");
+    for (int i = 0; i<game->numPlayers; i++) {
+        player_t* curPlayer = game->allPlayers[i];
+        length += sprintf(gameOverMsg + length, "%-3c %7d %.50s\n", player_get_c(curPlayer), player_get_score(curPlayer), player_get_name(curPlayer));
     }
 
     //print summary
     printf("%s", gameOverMsg);
 
-    //send game over message to all players
-    for (int i = 0; i<game.numPlayers; i++) {
-        message_send(player_get_addr(game.allPlayers[i]), gameOverMsg);
+    //send game over message to all players, and the spectator
+    addr_t* to = mem_malloc_assert((game->numPlayers + 1) * sizeof(addr_t), "gameOver");
+    const char** messages = mem_malloc_assert((game->numPlayers + 1) * sizeof(char*), "gameOver");
+    int count = 0;
+    for (int i = 0; i<game->numPlayers; i++) {
+        to[count] = player_get_addr(game->allPlayers[i]);
+        messages[count++] = gameOverMsg;
     }
-
-    //send game over message to spectator
-    if (game.hasSpect) {
-        message_send(game.spect, gameOverMsg);
+    if (game->hasSpect) {
+        to[count] = game->spect;
+        messages[count++] = gameOverMsg;
     }
+    message_sendBatch(to, messages, count);
+    mem_free(to);
+    mem_free(messages);
+    mem_free(gameOverMsg);
 }
@@ -0,0 +1,199 @@
+/*
+ * CS50 Nuggets Project
+ * Team 17 - CecsC
+ *
+ * addrtable.c - CS50 'addrtable' module
+ * The addrtable module maps client addresses to small integers, in an
+ * open-addressing hash table with linear probing. Removing an entry
+ * shifts later entries of its probe run back, so there are no tombstones
+ * and lookups never slow down as clients come and go.
+ *
+ * see addrtable.h for more information.
+ *
+ * CecsC 2023
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "message.h"
+#include "addrtable.h"
+
+/**************** global types ****************/
+typedef struct slot {
+  addr_t addr;
+  int value;                    // -1 if the slot is empty
+} slot_t;
+
+typedef struct addrtable {
+  slot_t* slots;
+  int capacity;                 // number of slots, a power of two
+  int count;                    // number of slots in use
+} addrtable_t;
+
+/**************** local functions ****************/
+static slot_t* newSlots(const int capacity);
+static bool grow(addrtable_t* table);
+
+/**************** addrtable_new ****************/
+/* see addrtable.h for description */
+addrtable_t*
+addrtable_new(const int size)
+{
+  addrtable_t* table = malloc(sizeof(addrtable_t));
+  if (table == NULL) {
+    return NULL;
+  }
+
+  // keep the table at most three-quarters full
+  table->capacity = 8;
+  while (table->capacity * 3 < size * 4) {
+    table->capacity *= 2;
+  }
+  table->count = 0;
+  table->slots = newSlots(table->capacity);
+  if (table->slots == NULL) {
+    free(table);
+    return NULL;
+  }
+  return table;
+}
+
+/**************** addrtable_insert ****************/
+/* see addrtable.h for description */
+bool
+addrtable_insert(addrtable_t* table, const addr_t addr, const int value)
+{
+  if (table == NULL || value == -1) {
+    return false;
+  }
+  if ((table->count + 1) * 4 > table->capacity * 3 && !grow(table)) {
+    return false;
+  }
+
+  int mask = table->capacity - 1;
+  int i = message_hashAddr(addr) & mask;
+  while (table->slots[i].value != -1) {
+    if (message_eqAddr(table->slots[i].addr, addr)) {
+      table->slots[i].value = value;
+      return true;
+    }
+    i = (i + 1) & mask;
+  }
+  table->slots[i].addr = addr;
+  table->slots[i].value = value;
+  table->count++;
+  return true;
+}
+
+/**************** addrtable_find ****************/
+/* see addrtable.h for description */
+int
+addrtable_find(addrtable_t* table, const addr_t addr)
+{
+  if (table == NULL) {
+    return -1;
+  }
+
+  int mask = table->capacity - 1;
+  for (int i = message_hashAddr(addr) & mask; table->slots[i].value != -1; i = (i + 1) & mask) {
+    if (message_eqAddr(table->slots[i].addr, addr)) {
+      return table->slots[i].value;
+    }
+  }
+  return -1;
+}
+
+/**************** addrtable_remove ****************/
+/* see addrtable.h for description */
+int
+addrtable_remove(addrtable_t* table, const addr_t addr)
+{
+  if (table == NULL) {
+    return -1;
+  }
+
+  int mask = table->capacity - 1;
+  int i = message_hashAddr(addr) & mask;
+  while (table->slots[i].value != -1 && !message_eqAddr(table->slots[i].addr, addr)) {
+    i = (i + 1) & mask;
+  }
+  int value = table->slots[i].value;
+  if (value == -1) {
+    return -1;
+  }
+
+  // close the gap: move back each later entry of the run that the gap
+  // now hides from its home slot
+  int gap = i;
+  for (int j = (i + 1) & mask; table->slots[j].value != -1; j = (j + 1) & mask) {
+    int home = message_hashAddr(table->slots[j].addr) & mask;
+    if (((j - home) & mask) >= ((j - gap) & mask)) {
+      table->slots[gap] = table->slots[j];
+      gap = j;
+    }
+  }
+  table->slots[gap].value = -1;
+  table->count--;
+  return value;
+}
+
+/**************** addrtable_count ****************/
+/* see addrtable.h for description */
+int
+addrtable_count(addrtable_t* table)
+{
+  return (table == NULL) ? 0 : table->count;
+}
+
+/**************** addrtable_delete ****************/
+/* see addrtable.h for description */
+void
+addrtable_delete(addrtable_t* table)
+{
+  if (table != NULL) {
+    free(table->slots);
+    free(table);
+  }
+}
+
+/**************** newSlots ****************/
+/* Returns 'capacity' empty slots, or NULL if out of memory.
+ */
+static slot_t*
+newSlots(const int capacity)
+{
+  slot_t* slots = malloc(capacity * sizeof(slot_t));
+  if (slots != NULL) {
+    for (int i = 0; i < capacity; i++) {
+      slots[i].value = -1;
+    }
+  }
+  return slots;
+}
+
+/**************** grow ****************/
+/* Doubles the number of slots, and reinserts every entry.
+ * Returns false, leaving the table as it was, if out of memory.
+ */
+static bool
+grow(addrtable_t* table)
+{
+  slot_t* old = table->slots;
+  int oldCapacity = table->capacity;
+  slot_t* slots = newSlots(oldCapacity * 2);
+  if (slots == NULL) {
+    return false;
+  }
+
+  table->slots = slots;
+  table->capacity = oldCapacity * 2;
+  table->count = 0;
+  for (int i = 0; i < oldCapacity; i++) {
+    if (old[i].value != -1) {
+      addrtable_insert(table, old[i].addr, old[i].value);
+    }
+  }
+  free(old);
+  return true;
+}
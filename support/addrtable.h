@@ -0,0 +1,77 @@
+/*
+* Team 17 - CecsC
+* Nuggets Final Project
+* COSC 50, 23S
+*
+* addrtable.h - header file for addrtable.c
+*
+* addrtable module maps client addresses to small integers (a player's
+* index, a game's number), so the server can find who sent a message
+* without scanning every player. It is an open-addressing hash table
+* with linear probing, that grows as needed.
+*/
+
+#ifndef __ADDRTABLE_H
+#define __ADDRTABLE_H
+
+#include <stdbool.h>
+#include "message.h"
+
+typedef struct addrtable addrtable_t;
+
+/******** addrtable_new **************
+ * creates an empty table
+ * inputs:
+ *     size - number of entries expected; the table grows past it if needed
+ * output:
+ *     the new table, or NULL if out of memory
+ * notes:
+ *     caller must later free the table via addrtable_delete()
+ */
+addrtable_t* addrtable_new(const int size);
+
+/******** addrtable_insert **************
+ * maps an address to a value, replacing any value it had
+ * inputs:
+ *     table - table of interest
+ *     addr - the key
+ *     value - any value but -1
+ * output:
+ *     true if the address is now mapped to value; false if table is NULL,
+ *     value is -1, or the table could not grow
+ */
+bool addrtable_insert(addrtable_t* table, const addr_t addr, const int value);
+
+/******** addrtable_find **************
+ * looks up an address
+ * inputs:
+ *     table - table of interest
+ *     addr - the key
+ * output:
+ *     the value mapped to addr, or -1 if there is none (or table is NULL)
+ */
+int addrtable_find(addrtable_t* table, const addr_t addr);
+
+/******** addrtable_remove **************
+ * removes an address from the table, if it is there
+ * inputs:
+ *     table - table of interest
+ *     addr - the key
+ * output:
+ *     the value addr was mapped to, or -1 if there was none
+ */
+int addrtable_remove(addrtable_t* table, const addr_t addr);
+
+/******** addrtable_count **************
+ * output: the number of addresses in the table, 0 if table is NULL
+ */
+int addrtable_count(addrtable_t* table);
+
+/******** addrtable_delete **************
+ * frees the table
+ * inputs:
+ *     table - table of interest; ignored if NULL
+ */
+void addrtable_delete(addrtable_t* table);
+
+#endif // __ADDRTABLE_H
@@ -0,0 +1,65 @@
+/*
+ * addrtabletest.c - testing for addrtable
+ *
+ * Fills a table with many client addresses, removes every other one, and
+ * checks that each lookup still finds the right value.
+ *
+ * CS50 Nuggets Final Project
+ * Team 17 - CecsC
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "message.h"
+#include "addrtable.h"
+
+static const int numClients = 1000;
+
+int main()
+{
+    addr_t clients[numClients];
+    for (int i = 0; i < numClients; i++) {
+        char port[10];
+        sprintf(port, "%d", 20000 + i);
+        if (!message_setAddr("127.0.0.1", port, &clients[i])) {
+            fprintf(stderr, "cannot make address for port %s\n", port);
+            return 1;
+        }
+    }
+
+    // starts small, so it has to grow
+    addrtable_t* table = addrtable_new(4);
+    int errors = 0;
+
+    for (int i = 0; i < numClients; i++) {
+        addrtable_insert(table, clients[i], i);
+    }
+    printf("inserted %d addresses: count %d\n", numClients, addrtable_count(table));
+
+    // inserting again replaces the value
+    addrtable_insert(table, clients[7], 700);
+    printf("replaced one value: count %d, value %d\n", addrtable_count(table), addrtable_find(table, clients[7]));
+    addrtable_insert(table, clients[7], 7);
+
+    for (int i = 0; i < numClients; i += 2) {
+        if (addrtable_remove(table, clients[i]) != i) {
+            errors++;
+        }
+    }
+    printf("removed the even ones: count %d\n", addrtable_count(table));
+
+    for (int i = 0; i < numClients; i++) {
+        int expected = (i % 2 == 0) ? -1 : i;
+        if (addrtable_find(table, clients[i]) != expected) {
+            errors++;
+        }
+    }
+    printf("removing a missing address gives %d\n", addrtable_remove(table, clients[0]));
+    printf("inserting value -1 gives %s\n", addrtable_insert(table, clients[0], -1) ? "true" : "false");
+    printf("NULL table: find %d, count %d\n", addrtable_find(NULL, clients[1]), addrtable_count(NULL));
+    printf("%d lookups gave the wrong value\n", errors);
+
+    addrtable_delete(table);
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,507 @@
+/*
+ * loadgen - a headless load generator for the Nuggets server
+ *
+ * Given the address of a server, loadgen joins it with many simulated
+ * players and spectators, each from its own UDP socket, so the server sees
+ * each one as a separate client.  Each player sends keystrokes at a target
+ * rate, picked from a mix of single steps, sprints and quits; spectators
+ * only watch.  When the run ends, loadgen reports what it sent and received:
+ * round-trip latency percentiles by kind of message, the number and bytes of
+ * DISPLAY (or DELTA) frames, and keystrokes or frames that went missing.
+ *
+ * Round-trip latency is measured from a message to the next message its
+ * client receives, so it is only an estimate: a step into a wall brings back
+ * no frame at all (it is counted as unanswered), and a frame caused by some
+ * other player's move may arrive first.  With --delta the clients ask for
+ * DELTA frames, whose sequence numbers show exactly how many frames were lost.
+ *
+ * Each server game holds at most 500 players (MAX_PLAYERS in server.c) and
+ * one spectator, so run the server with one map per 500 players; spectators
+ * beyond one per game replace each other.
+ *
+ * usage: loadgen [options] hostname port
+ *   --players N        simulated players (default 10)
+ *   --spectators N     simulated spectators (default 0)
+ *   --rate R           keystrokes per second from each player (default 10)
+ *   --mix S,P,Q        percent of steps, sprints and quits (default 90,10,0)
+ *   --duration secs    how long players send keystrokes (default 10)
+ *   --timeout ms       how long to wait for a reply (default 1000)
+ *   --delta            ask for DELTA frames instead of DISPLAY frames
+ *   --rle              ask for run-length encoded full frames
+ *   --seed n           seed for the random keystrokes (default 1)
+ *
+ * Exit status: 0 on success, 1 on bad arguments, 2 if the server address
+ * is bad, 3 if the sockets cannot be made.
+ *
+ * CS50 Nuggets Final Project
+ * Team 17 - CecsC
+ */
+
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "message.h"
+
+/**************** file-local types ****************/
+
+// kinds of message whose round trip we time
+typedef enum { JOIN, STEP, SPRINT, QUIT, NUM_KINDS } kind_t;
+static const char* kindNames[NUM_KINDS] = { "join", "step", "sprint", "quit" };
+
+// round-trip times of one kind of message, in milliseconds
+typedef struct samples {
+  double* ms;
+  int count;
+  int size;
+} samples_t;
+
+// one simulated player or spectator
+typedef struct client {
+  int fd;               // its own socket, connected to the server
+  bool spectator;
+  bool joined;          // the server answered its PLAY or SPECTATE
+  bool done;            // it quit, or the server told it to QUIT
+  double sentAt;        // when the message awaiting a reply was sent; 0 if none
+  kind_t sentKind;      // kind of that message
+  double nextKey;       // when it sends its next keystroke
+  int seq;              // highest DELTA sequence number received
+} client_t;
+
+// everything the run sent and received
+typedef struct stats {
+  samples_t rtt[NUM_KINDS];
+  long sent[NUM_KINDS];
+  long unanswered;      // messages with no reply within the timeout
+  long refused;         // joins the server turned away
+  long frames;          // DISPLAY or DELTA messages
+  long frameBytes;
+  long gold;            // GOLD messages
+  long errors;          // ERROR messages
+  long quits;           // QUIT messages
+  long lostFrames;      // gaps in DELTA sequence numbers
+  long resyncs;
+} stats_t;
+
+/**************** file-local functions ****************/
+
+static bool parseArgs(const int argc, char* argv[], int* numPlayers, int* numSpectators,
+                      double* rate, int mix[3], double* duration, double* timeout,
+                      bool* delta, bool* rle, unsigned* seed);
+static bool openClient(client_t* client, const addr_t server);
+static void sendMessage(client_t* client, const char* message);
+static void sendKey(client_t* client, const int mix[3], stats_t* stats, double t);
+static void receive(client_t* client, char* buf, stats_t* stats, double t);
+static void expire(client_t* client, stats_t* stats, double t, double timeout);
+static void addSample(samples_t* samples, double ms);
+static void report(stats_t* stats, int numPlayers, int numSpectators, double elapsed);
+static int compareDoubles(const void* a, const void* b);
+static double now(void);
+
+/***************** main *******************************/
+int
+main(const int argc, char* argv[])
+{
+  int numPlayers = 10, numSpectators = 0;
+  double rate = 10, duration = 10, timeout = 1.0;
+  int mix[3] = { 90, 10, 0 };
+  bool delta = false;
+  bool rle = false;
+  unsigned seed = 1;
+  if (!parseArgs(argc, argv, &numPlayers, &numSpectators, &rate, mix,
+                 &duration, &timeout, &delta, &rle, &seed)) {
+    fprintf(stderr, "usage: %s [--players N] [--spectators N] [--rate R] [--mix S,P,Q]\n"
+            "       [--duration secs] [--timeout ms] [--delta] [--rle] [--seed n] hostname port\n", argv[0]);
+    return 1; // bad commandline
+  }
+  srand(seed);
+
+  addr_t server;
+  if (!message_setAddr(argv[argc-2], argv[argc-1], &server)) {
+    fprintf(stderr, "can't form address from %s %s\n", argv[argc-2], argv[argc-1]);
+    return 2; // bad hostname/port
+  }
+
+  // open every client's socket before anyone joins
+  int numClients = numPlayers + numSpectators;
+  client_t* clients = calloc(numClients, sizeof(client_t));
+  struct pollfd* fds = calloc(numClients, sizeof(struct pollfd));
+  char* buf = malloc(message_MaxBytes + 1);
+  if (clients == NULL || fds == NULL || buf == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 3;
+  }
+  for (int i = 0; i < numClients; i++) {
+    clients[i].spectator = (i >= numPlayers);
+    if (!openClient(&clients[i], server)) {
+      fprintf(stderr, "can't open socket %d: %s\n", i, strerror(errno));
+      return 3;
+    }
+    fds[i].fd = clients[i].fd;
+    fds[i].events = POLLIN;
+  }
+
+  // join, with each player's first keystroke at a random moment
+  // within its first interval, so they do not all arrive together
+  stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  double start = now();
+  for (int i = 0; i < numClients; i++) {
+    client_t* client = &clients[i];
+    char join[32];
+    if (client->spectator) {
+      sprintf(join, "SPECTATE");
+    } else {
+      sprintf(join, "PLAY lg%d", i + 1);
+    }
+    client->sentKind = JOIN;
+    sendMessage(client, join);
+    stats.sent[JOIN]++;
+    client->sentAt = now();
+    if (delta) {
+      sendMessage(client, "DELTA");
+    }
+    if (rle) {
+      sendMessage(client, "RLE");
+    }
+    client->nextKey = start + (rand() / (RAND_MAX + 1.0)) / rate;
+  }
+
+  // send keystrokes until the end of the run, then wait for the last replies
+  double stopKeys = start + duration;
+  double stop = stopKeys + timeout;
+  for (double t = now(); t < stop; t = now()) {
+    double wake = stop;
+    for (int i = 0; i < numClients; i++) {
+      client_t* client = &clients[i];
+      expire(client, &stats, t, timeout);
+      if (client->done || client->spectator || !client->joined || t >= stopKeys) {
+        continue;
+      }
+      if (t >= client->nextKey) {
+        sendKey(client, mix, &stats, t);
+        client->nextKey += 1 / rate;
+        if (client->nextKey < t) {
+          client->nextKey = t + 1 / rate;   // we fell behind; do not catch up in a burst
+        }
+      }
+      if (client->nextKey < wake) {
+        wake = client->nextKey;
+      }
+    }
+
+    int waitMs = (int) ((wake - now()) * 1000) + 1;
+    if (poll(fds, numClients, waitMs > 0 ? waitMs : 0) < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+    t = now();
+    for (int i = 0; i < numClients; i++) {
+      if (fds[i].revents & POLLIN) {
+        receive(&clients[i], buf, &stats, t);
+      }
+    }
+  }
+  double elapsed = now() - start;
+
+  // leave the game, without counting these; anything still awaiting a reply
+  // has now waited at least the timeout
+  for (int i = 0; i < numClients; i++) {
+    if (clients[i].sentAt > 0) {
+      stats.unanswered++;
+    }
+    if (clients[i].joined && !clients[i].done) {
+      sendMessage(&clients[i], "KEY Q");
+    }
+    close(clients[i].fd);
+  }
+
+  report(&stats, numPlayers, numSpectators, elapsed);
+
+  for (int k = 0; k < NUM_KINDS; k++) {
+    free(stats.rtt[k].ms);
+  }
+  free(buf);
+  free(fds);
+  free(clients);
+  return 0;
+}
+
+/**************** parseArgs ****************/
+/* Reads the options into the given variables; the last two arguments
+ * must be the hostname and port.
+ * Returns false if any argument is bad.
+ */
+static bool
+parseArgs(const int argc, char* argv[], int* numPlayers, int* numSpectators,
+          double* rate, int mix[3], double* duration, double* timeout,
+          bool* delta, bool* rle, unsigned* seed)
+{
+  if (argc < 3) {
+    return false;
+  }
+  for (int i = 1; i < argc - 2; i++) {
+    const char* arg = argv[i];
+    const char* value = (i + 1 < argc - 2) ? argv[i+1] : NULL;
+    char extra;
+    if (strcmp(arg, "--delta") == 0) {
+      *delta = true;
+      continue;
+    }
+    if (strcmp(arg, "--rle") == 0) {
+      *rle = true;
+      continue;
+    }
+    if (value == NULL) {
+      return false;
+    }
+    double ms;
+    if (strcmp(arg, "--players") == 0) {
+      if (sscanf(value, "%d%c", numPlayers, &extra) != 1 || *numPlayers < 0) {
+        return false;
+      }
+    } else if (strcmp(arg, "--spectators") == 0) {
+      if (sscanf(value, "%d%c", numSpectators, &extra) != 1 || *numSpectators < 0) {
+        return false;
+      }
+    } else if (strcmp(arg, "--rate") == 0) {
+      if (sscanf(value, "%lf%c", rate, &extra) != 1 || *rate <= 0) {
+        return false;
+      }
+    } else if (strcmp(arg, "--mix") == 0) {
+      if (sscanf(value, "%d,%d,%d%c", &mix[0], &mix[1], &mix[2], &extra) != 3
+          || mix[0] < 0 || mix[1] < 0 || mix[2] < 0 || mix[0] + mix[1] + mix[2] == 0) {
+        return false;
+      }
+    } else if (strcmp(arg, "--duration") == 0) {
+      if (sscanf(value, "%lf%c", duration, &extra) != 1 || *duration < 0) {
+        return false;
+      }
+    } else if (strcmp(arg, "--timeout") == 0) {
+      if (sscanf(value, "%lf%c", &ms, &extra) != 1 || ms <= 0) {
+        return false;
+      }
+      *timeout = ms / 1000;
+    } else if (strcmp(arg, "--seed") == 0) {
+      if (sscanf(value, "%u%c", seed, &extra) != 1) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+    i++;
+  }
+  return *numPlayers + *numSpectators > 0;
+}
+
+/**************** openClient ****************/
+/* Opens a nonblocking UDP socket for one client, on a port of its own,
+ * connected to the server so it only hears from the server.
+ * Returns false on error.
+ */
+static bool
+openClient(client_t* client, const addr_t server)
+{
+  client->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (client->fd < 0) {
+    return false;
+  }
+  // room for a burst of full frames while we are busy with other clients
+  int size = 1 << 20;
+  setsockopt(client->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  return connect(client->fd, (const struct sockaddr*) &server, sizeof(server)) == 0
+    && fcntl(client->fd, F_SETFL, O_NONBLOCK) == 0;
+}
+
+/**************** sendMessage ****************/
+/* Sends one message from this client to the server.
+ */
+static void
+sendMessage(client_t* client, const char* message)
+{
+  if (send(client->fd, message, strlen(message), 0) < 0) {
+    perror("send");
+  }
+}
+
+/**************** sendKey ****************/
+/* Sends one keystroke from this player, picked from the mix, in a random
+ * direction.  A keystroke still awaiting its reply is counted unanswered.
+ */
+static void
+sendKey(client_t* client, const int mix[3], stats_t* stats, double t)
+{
+  static const char steps[] = "hjklyubn";
+  static const char sprints[] = "HJKLYUBN";
+
+  if (client->sentAt > 0) {
+    stats->unanswered++;
+  }
+
+  int pick = rand() % (mix[0] + mix[1] + mix[2]);
+  int direction = rand() % 8;
+  char key[8];
+  if (pick < mix[0]) {
+    client->sentKind = STEP;
+    sprintf(key, "KEY %c", steps[direction]);
+  } else if (pick < mix[0] + mix[1]) {
+    client->sentKind = SPRINT;
+    sprintf(key, "KEY %c", sprints[direction]);
+  } else {
+    client->sentKind = QUIT;
+    sprintf(key, "KEY Q");
+  }
+  sendMessage(client, key);
+  stats->sent[client->sentKind]++;
+  client->sentAt = t;
+}
+
+/**************** receive ****************/
+/* Reads every message waiting on this client's socket.  The first one
+ * answers the message the client is waiting on, if any.
+ */
+static void
+receive(client_t* client, char* buf, stats_t* stats, double t)
+{
+  ssize_t length;
+  while ((length = recv(client->fd, buf, message_MaxBytes, 0)) >= 0) {
+    buf[length] = '\0';
+    if (client->sentAt > 0) {
+      addSample(&stats->rtt[client->sentKind], (t - client->sentAt) * 1000);
+      client->sentAt = 0;
+    }
+
+    if (strncmp(buf, "DISPLAY\n", strlen("DISPLAY\n")) == 0
+        || strncmp(buf, "DISPLAY RLE\n", strlen("DISPLAY RLE\n")) == 0) {
+      stats->frames++;
+      stats->frameBytes += length;
+    } else if (strncmp(buf, "DELTA ", strlen("DELTA ")) == 0) {
+      stats->frames++;
+      stats->frameBytes += length;
+      int seq, base;
+      if (sscanf(buf, "DELTA %d %d", &seq, &base) == 2) {
+        if (seq > client->seq + 1) {
+          stats->lostFrames += seq - client->seq - 1;
+        }
+        if (base != 0 && base != client->seq) {
+          sendMessage(client, "RESYNC");
+          stats->resyncs++;
+        }
+        if (seq > client->seq) {
+          client->seq = seq;
+        }
+      }
+    } else if (strncmp(buf, "GOLD ", strlen("GOLD ")) == 0) {
+      stats->gold++;
+    } else if (strncmp(buf, "ERROR", strlen("ERROR")) == 0) {
+      stats->errors++;
+    } else if (strncmp(buf, "QUIT", strlen("QUIT")) == 0) {
+      stats->quits++;
+      if (!client->joined) {
+        stats->refused++;
+      }
+      client->done = true;
+    }
+    // OK, GRID or the spectator's first frame means we are in
+    if (!client->done) {
+      client->joined = true;
+    }
+  }
+}
+
+/**************** expire ****************/
+/* Gives up on this client's outstanding message if it has waited longer
+ * than the timeout.  A join that is never answered ends the client.
+ */
+static void
+expire(client_t* client, stats_t* stats, double t, double timeout)
+{
+  if (client->sentAt > 0 && t - client->sentAt > timeout) {
+    stats->unanswered++;
+    client->sentAt = 0;
+    if (!client->joined) {
+      client->done = true;
+    }
+  }
+}
+
+/**************** addSample ****************/
+/* Adds one round-trip time, growing the array as needed.
+ */
+static void
+addSample(samples_t* samples, double ms)
+{
+  if (samples->count == samples->size) {
+    int size = (samples->size == 0) ? 1024 : samples->size * 2;
+    double* grown = realloc(samples->ms, size * sizeof(double));
+    if (grown == NULL) {
+      return; // keep the samples we have
+    }
+    samples->ms = grown;
+    samples->size = size;
+  }
+  samples->ms[samples->count++] = ms;
+}
+
+/**************** report ****************/
+/* Prints what was sent and received, and the latency percentiles.
+ */
+static void
+report(stats_t* stats, int numPlayers, int numSpectators, double elapsed)
+{
+  long keys = stats->sent[STEP] + stats->sent[SPRINT] + stats->sent[QUIT];
+  printf("clients: %d players, %d spectators, %ld refused, %.1f s\n",
+         numPlayers, numSpectators, stats->refused, elapsed);
+  printf("sent: %ld joins, %ld keys (%ld steps, %ld sprints, %ld quits), %.0f keys/s\n",
+         stats->sent[JOIN], keys, stats->sent[STEP], stats->sent[SPRINT], stats->sent[QUIT],
+         elapsed > 0 ? keys / elapsed : 0);
+  printf("received: %ld frames, %ld frame bytes (%.0f bytes/s), %ld GOLD, %ld ERROR, %ld QUIT\n",
+         stats->frames, stats->frameBytes, elapsed > 0 ? stats->frameBytes / elapsed : 0,
+         stats->gold, stats->errors, stats->quits);
+  long sent = stats->sent[JOIN] + keys;
+  printf("unanswered: %ld of %ld (%.2f%%)\n", stats->unanswered, sent,
+         sent > 0 ? 100.0 * stats->unanswered / sent : 0);
+  printf("lost frames: %ld, resyncs: %ld\n", stats->lostFrames, stats->resyncs);
+
+  printf("%-8s %8s %9s %9s %9s %9s\n", "rtt ms", "count", "p50", "p90", "p99", "max");
+  for (int k = 0; k < NUM_KINDS; k++) {
+    samples_t* s = &stats->rtt[k];
+    if (s->count == 0) {
+      continue;
+    }
+    qsort(s->ms, s->count, sizeof(double), compareDoubles);
+    printf("%-8s %8d %9.3f %9.3f %9.3f %9.3f\n", kindNames[k], s->count,
+           s->ms[s->count * 50 / 100], s->ms[s->count * 90 / 100],
+           s->ms[s->count * 99 / 100], s->ms[s->count - 1]);
+  }
+}
+
+/**************** compareDoubles ****************/
+/* qsort comparison, ascending.
+ */
+static int
+compareDoubles(const void* a, const void* b)
+{
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+/**************** now ****************/
+/* Seconds on a monotonic clock.
+ */
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
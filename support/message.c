@@ -13,9 +13,12 @@
  * David Kotz - May 2019
  */
 
+#define _GNU_SOURCE       // sendmmsg, recvmmsg, epoll
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -23,6 +26,10 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #include <math.h>
 #include "message.h"
 #include "log.h"
@@ -48,6 +55,29 @@ static const int MaxPort = 65535;
  */
 static int ourSocket = 0;     // socket on which to receive messages
 
+/* On Linux we send and receive up to message_BatchSize datagrams per
+ * system call. The receive buffers are allocated by message_init.
+ */
+#ifdef __linux__
+#define MESSAGE_MMSG
+static char* recvBufs = NULL;  // message_BatchSize buffers of message_MaxBytes
+#endif
+
+/* The event backend chosen at message_initWith. With message_EPOLL,
+ * epollFd watches the socket and every extra fd for the life of the module;
+ * otherwise it is -1 and message_loop rebuilds an fd_set for select().
+ */
+static int epollFd = -1;
+
+/* Extra file descriptors registered with message_addFd, and their handlers.
+ */
+#define MaxExtraFds 16
+static struct extraFd {
+  int fd;
+  bool (*handleFd)(void* arg, int fd);
+} extraFds[MaxExtraFds];
+static int numExtraFds = 0;
+
 /***********************************************************************/
 /**************** message_init ****************/
 /* 
@@ -58,6 +88,18 @@ static int ourSocket = 0;     // socket on which to receive messages
  */
 int
 message_init(FILE* logFP)
+{
+  return message_initWith(logFP, message_SELECT);
+}
+
+/**************** message_initWith ****************/
+/* 
+ * Like message_init, but using the given event backend for message_loop.
+ * Invariant: epollFd >= 0 iff the epoll backend is in use.
+ * See message.h for detailed description.
+ */
+int
+message_initWith(FILE* logFP, const message_backend_t backend)
 {
   log_init(logFP);
 
@@ -95,6 +137,40 @@ message_init(FILE* logFP)
     ourSocket = 0;
     return 0;
   }
+  // set up the epoll backend, if asked for and available
+  if (backend == message_EPOLL) {
+#ifdef __linux__
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = ourSocket };
+    epollFd = epoll_create1(0);
+    if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, ourSocket, &event) < 0) {
+      log_e("message_init: setting up epoll");
+      if (epollFd >= 0) {
+        close(epollFd);
+        epollFd = -1;
+      }
+      close(ourSocket);
+      ourSocket = 0;
+      return 0;
+    }
+#else
+    log_v("message_init: epoll not available; using select");
+#endif
+  }
+
+#ifdef MESSAGE_MMSG
+  recvBufs = malloc((size_t) message_BatchSize * message_MaxBytes);
+  if (recvBufs == NULL) {
+    log_v("message_init: out of memory for receive buffers");
+    if (epollFd >= 0) {
+      close(epollFd);
+      epollFd = -1;
+    }
+    close(ourSocket);
+    ourSocket = 0;
+    return 0;
+  }
+#endif
+
   // extract our port number
   int port = ntohs(self.sin_port);
   log_d("message_init: ready at port '%d'", port);
@@ -145,6 +221,35 @@ message_eqAddr(const addr_t a, const addr_t b)
     && a.sin_addr.s_addr == b.sin_addr.s_addr;
 }
 
+/**************** message_isLocal ****************/
+/* 
+ * Return true if the address is a loopback address.
+ * See message.h for detailed description.
+ */
+bool
+message_isLocal(const addr_t addr)
+{
+  return 
+    addr.sin_family == AF_INET
+    && (ntohl(addr.sin_addr.s_addr) >> 24) == 127;
+}
+
+/**************** message_hashAddr ****************/
+/* 
+ * Return a hash of the address, for tables keyed by address.
+ * See message.h for detailed description.
+ */
+unsigned long
+message_hashAddr(const addr_t addr)
+{
+  // mix the IP address and port, so nearby ports spread over the table
+  uint64_t key = ((uint64_t) addr.sin_addr.s_addr << 16) ^ addr.sin_port;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (unsigned long) key;
+}
+
 /**************** message_setAddr ****************/
 /* 
  * Convert a textual address into a correspondent address.
@@ -190,19 +295,24 @@ message_setAddr(const char* hostname, const char* portString, addr_t* addr)
 
 /**************** message_stringAddr ****************/
 /* Produce a string representation of the address.
- * Returns pointer to static storage that should not be retained
- * (because every call to this function returns the same pointer).
- * See message.h for detailed description.
+ * Returns pointer to per-thread static storage that should not be retained
+ * (because every call to this function, in one thread, returns the same
+ * pointer). See message.h for detailed description.
  */
 const char*
 message_stringAddr(const addr_t addr)
 {
   // Maximum string length to hold an IP address and port, plus null.
   // e.g., 255.255.255.255:65507
-  static char addrString[22]; // constant appears in snprintf below
+  // One per thread, so that server threads can format addresses at once;
+  // inet_ntop, unlike inet_ntoa, writes into our buffer, not a static one.
+  static _Thread_local char addrString[22]; // constant appears in snprintf below
+  char ip[INET_ADDRSTRLEN];
 
-  snprintf(addrString, 22, "%s:%05d",
-	   inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+  if (inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip)) == NULL) {
+    strcpy(ip, "?");
+  }
+  snprintf(addrString, 22, "%s:%05d", ip, ntohs(addr.sin_port));
 
   return addrString;
 }
@@ -256,13 +366,311 @@ message_send(const addr_t to, const char* message)
   if (sendto(ourSocket, message, strlen(message), 0,
              (struct sockaddr *) &to, sizeof(to)) < 0) {
     log_e("message_send: error sending to datagram socket");
-  } else {
+  } else if (logFP != NULL) {
+    // only format the address and count the lines if we are logging
     log_s("message_send: TO %s", message_stringAddr(to));
     log_d("message_send: %d lines:", numLines(message));
     log_s("%s", message);
   }
 }
 
+/**************** message_sendBatch ****************/
+/* 
+ * Send each messages[i] to to[i], in order.
+ * See message.h for detailed description.
+ */
+void
+message_sendBatch(const addr_t to[], const char* messages[], const int count)
+{
+  if (ourSocket == 0) {
+    log_v("message_sendBatch: called before message_init");
+    return; // error in usage of this function.
+  }
+  if (to == NULL || messages == NULL) {
+    log_v("message_sendBatch: called with null array");
+    return; // error in usage of this function.
+  }
+
+#ifdef MESSAGE_MMSG
+  struct mmsghdr msgs[message_BatchSize];
+  struct iovec iovecs[message_BatchSize];
+
+  int sent = 0;                  // messages handed to the kernel so far
+  while (sent < count) {
+    // fill in headers for the next batch, skipping null messages
+    int n = 0;
+    int first = sent;
+    int index[message_BatchSize];  // index[k] is the message in msgs[k]
+    for (int i = first; i < count && n < message_BatchSize; i++) {
+      sent = i + 1;
+      if (messages[i] == NULL) {
+        log_v("message_sendBatch: called with null message");
+        continue;
+      }
+      iovecs[n].iov_base = (void*) messages[i];
+      iovecs[n].iov_len = strlen(messages[i]);
+      memset(&msgs[n], 0, sizeof(msgs[n]));
+      msgs[n].msg_hdr.msg_name = (void*) &to[i];
+      msgs[n].msg_hdr.msg_namelen = sizeof(to[i]);
+      msgs[n].msg_hdr.msg_iov = &iovecs[n];
+      msgs[n].msg_hdr.msg_iovlen = 1;
+      index[n++] = i;
+    }
+
+    // sendmmsg may stop early; carry on after the one that failed
+    int done = 0;
+    while (done < n) {
+      int r = sendmmsg(ourSocket, msgs + done, n - done, 0);
+      if (r < 0) {
+        log_e("message_sendBatch: error sending to datagram socket");
+        done++;
+        continue;
+      }
+      for (int k = done; k < done + r && logFP != NULL; k++) {
+        log_s("message_sendBatch: TO %s", message_stringAddr(to[index[k]]));
+        log_d("message_sendBatch: %d lines:", numLines(messages[index[k]]));
+        log_s("%s", messages[index[k]]);
+      }
+      done += r;
+    }
+  }
+#else
+  for (int i = 0; i < count; i++) {
+    message_send(to[i], messages[i]);
+  }
+#endif
+}
+
+/**************** handleReceived ****************/
+/*
+ * Log one received message and pass it to the handler.
+ * buf must be null-terminated.
+ * Returns true if the handler says to exit the loop.
+ */
+static bool
+handleReceived(void* arg, const struct sockaddr_in sender, const char* buf,
+               bool (*handleMessage)(void* arg,
+                                     const addr_t from, const char* buf))
+{
+  // where was it from?
+  if (sender.sin_family != AF_INET) {
+    // ignore it
+    log_d("message_loop: non-Internet family %d\n", sender.sin_family);
+    return false;
+  }
+
+  // record it, if we are logging
+  if (logFP != NULL) {
+    log_s("message_loop: FROM %s", message_stringAddr(sender));
+    log_d("message_loop: %d lines:", numLines(buf));
+    log_s("%s", buf);
+  }
+
+  // handle it
+  return (handleMessage != NULL && (*handleMessage)(arg, sender, buf));
+}
+
+/**************** receiveMessages ****************/
+/*
+ * The socket is ready: read what is waiting and handle each message.
+ * On Linux, one recvmmsg() call reads up to message_BatchSize messages;
+ * elsewhere we read just one.
+ * Returns true if a handler says to exit the loop; any messages after
+ * that one in the batch are dropped.
+ */
+static bool
+receiveMessages(void* arg,
+                bool (*handleMessage)(void* arg,
+                                      const addr_t from, const char* buf))
+{
+#ifdef MESSAGE_MMSG
+  struct mmsghdr msgs[message_BatchSize];
+  struct iovec iovecs[message_BatchSize];
+  struct sockaddr_in senders[message_BatchSize];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < message_BatchSize; i++) {
+    iovecs[i].iov_base = recvBufs + (size_t) i * message_MaxBytes;
+    iovecs[i].iov_len = message_MaxBytes - 1; // leave room for the null
+    msgs[i].msg_hdr.msg_name = &senders[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  // at least one message is waiting, so this returns without blocking
+  int n = recvmmsg(ourSocket, msgs, message_BatchSize, MSG_DONTWAIT, NULL);
+  if (n < 0) {
+    // error, ignore it
+    log_e("message_loop: receiving from socket");
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    char* buf = iovecs[i].iov_base;
+    buf[msgs[i].msg_len] = '\0';   // null terminate message string
+    if (handleReceived(arg, senders[i], buf, handleMessage)) {
+      return true;
+    }
+  }
+  return false;
+#else
+  struct sockaddr_in sender;     // sender of this message
+  struct sockaddr *senderp = (struct sockaddr *) &sender;
+  socklen_t senderlen = sizeof(sender);  // must pass address to length
+  char buf[message_MaxBytes]; // buffer for reading data from socket
+  int nbytes = recvfrom(ourSocket, buf, message_MaxBytes-1, 
+                        0, senderp, &senderlen);
+  if (nbytes < 0) {
+    // error, ignore it
+    log_e("message_loop: receiving from socket");
+    return false;
+  }
+  buf[nbytes] = '\0';     // null terminate message string
+  return handleReceived(arg, sender, buf, handleMessage);
+#endif
+}
+
+/**************** message_addFd ****************/
+/* 
+ * Watch another file descriptor in message_loop.
+ * See message.h for detailed description.
+ */
+bool
+message_addFd(const int fd, bool (*handleFd)(void* arg, int fd))
+{
+  if (ourSocket == 0) {
+    log_v("message_addFd: called before message_init");
+    return false;
+  }
+  if (fd < 0 || handleFd == NULL) {
+    log_v("message_addFd: called with bad fd or null handler");
+    return false;
+  }
+  if (numExtraFds == MaxExtraFds) {
+    log_d("message_addFd: already watching %d extra fds", MaxExtraFds);
+    return false;
+  }
+  if (epollFd < 0 && fd >= FD_SETSIZE) {
+    log_d("message_addFd: fd %d too large for select", fd);
+    return false;
+  }
+#ifdef __linux__
+  if (epollFd >= 0) {
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+      log_e("message_addFd: epoll_ctl");
+      return false;
+    }
+  }
+#endif
+  extraFds[numExtraFds].fd = fd;
+  extraFds[numExtraFds].handleFd = handleFd;
+  numExtraFds++;
+  return true;
+}
+
+/**************** message_removeFd ****************/
+/* 
+ * Stop watching a file descriptor added with message_addFd.
+ * See message.h for detailed description.
+ */
+bool
+message_removeFd(const int fd)
+{
+  for (int i = 0; i < numExtraFds; i++) {
+    if (extraFds[i].fd == fd) {
+#ifdef __linux__
+      if (epollFd >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+      }
+#endif
+      extraFds[i] = extraFds[--numExtraFds];
+      return true;
+    }
+  }
+  log_d("message_removeFd: fd %d was not added", fd);
+  return false;
+}
+
+/**************** handleExtraFd ****************/
+/*
+ * An extra fd is ready: call its handler, if it is still registered.
+ * Returns true if the handler says to exit the loop.
+ */
+static bool
+handleExtraFd(void* arg, const int fd)
+{
+  for (int i = 0; i < numExtraFds; i++) {
+    if (extraFds[i].fd == fd) {
+      return (*extraFds[i].handleFd)(arg, fd);
+    }
+  }
+  return false;
+}
+
+#ifdef __linux__
+/**************** epollLoop ****************/
+/*
+ * message_loop for the epoll backend. The socket and extra fds are already
+ * in the epoll set; stdin is added only for the duration of the loop.
+ */
+static bool
+epollLoop(void* arg, const float timeout,
+          bool (*handleTimeout)(void* arg),
+          bool (*handleInput)  (void* arg),
+          bool (*handleMessage)(void* arg,
+                                const addr_t from, const char* buf))
+{
+  if (handleInput != NULL) {
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = 0 };
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, 0, &event) < 0) {
+      log_e("message_loop: cannot watch stdin with epoll");
+      return false;
+    }
+  }
+  int timeoutMs = (timeout > 0.0) ? (int)(timeout * 1000) : -1;
+
+  bool ok = true;
+  bool done = false;
+  while (!done) {
+    struct epoll_event events[MaxExtraFds + 2];
+    int n = epoll_wait(epollFd, events, MaxExtraFds + 2, timeoutMs);
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        // interrupted by a signal; loop around to epoll_wait() again.
+        log_e("message_loop: epoll_wait() EINTR: interrupted by signal");
+      } else {
+        log_e("message_loop: epoll_wait()");
+        ok = false;
+        done = true;
+      }
+    } else if (n == 0) {
+      // timeout occurred
+      log_v("message_loop: epoll_wait() timed out");
+      done = (handleTimeout != NULL && (*handleTimeout)(arg));
+    }
+
+    for (int i = 0; i < n && !done; i++) {
+      int fd = events[i].data.fd;
+      if (fd == 0) {
+        log_v("message_loop: input ready on stdin");
+        done = (*handleInput)(arg);
+      } else if (fd == ourSocket) {
+        log_v("message_loop: message ready on socket");
+        done = receiveMessages(arg, handleMessage);
+      } else {
+        done = handleExtraFd(arg, fd);
+      }
+    }
+  }
+
+  if (handleInput != NULL) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, 0, NULL);
+  }
+  return ok;
+}
+#endif
+
 /**************** message_loop ****************/
 /* 
  * Loop forever, calling handler functions for stdin or socket,
@@ -303,8 +711,14 @@ message_loop(void* arg, const float timeout,
   struct timeval  timeoutval;     // timeval equivalent of parameter 'timeout'
   if (timeout > 0.0) {
     timeoutval.tv_sec  = (int)timeout;
-    timeoutval.tv_usec = timeout - (int)timeout;
+    timeoutval.tv_usec = (timeout - (int)timeout) * 1000000;
+  }
+
+#ifdef __linux__
+  if (epollFd >= 0) {
+    return epollLoop(arg, timeout, handleTimeout, handleInput, handleMessage);
   }
+#endif
 
   // loop until error or some handler indicates time to quit looping
   while (true) {
@@ -322,6 +736,12 @@ message_loop(void* arg, const float timeout,
       FD_SET(ourSocket, &rfds); // monitor the socket
       nfds = ourSocket+1;       // highest-numbered fd in rfds
     }
+    for (int i = 0; i < numExtraFds; i++) {
+      FD_SET(extraFds[i].fd, &rfds); // monitor each extra fd
+      if (extraFds[i].fd >= nfds) {
+        nfds = extraFds[i].fd+1;
+      }
+    }
     if (timeout > 0.0) {      // is timeout desired?
       timer = timeoutval;     // set the timer to the timeout value
       timerp = &timer;        // pass that timer to select
@@ -362,34 +782,25 @@ message_loop(void* arg, const float timeout,
       if (FD_ISSET(ourSocket, &rfds)) {
         // socket has input ready
         log_v("message_loop: message ready on socket");
-        struct sockaddr_in sender;     // sender of this message
-        struct sockaddr *senderp = (struct sockaddr *) &sender;
-        socklen_t senderlen = sizeof(sender);  // must pass address to length
-        char buf[message_MaxBytes]; // buffer for reading data from socket
-        int nbytes = recvfrom(ourSocket, buf, message_MaxBytes-1, 
-                              0, senderp, &senderlen);
-        if (nbytes < 0) {
-          // error, ignore it
-          log_e("message_loop: receiving from socket");
-        } else {
-          buf[nbytes] = '\0';     // null terminate message string
-          // where was it from?
-          if (sender.sin_family != AF_INET) {
-            // ignore it
-            log_d("message_loop: non-Internet family %d\n", sender.sin_family);
-          } else {
-	    // record it
-	    log_s("message_loop: FROM %s", message_stringAddr(sender));
-	    log_d("message_loop: %d lines:", numLines(buf));
-	    log_s("%s", buf);
-
-            // handle it
-            if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
-              break; // handler says to exit loop 
-            }
-          }
+        if (receiveMessages(arg, handleMessage)) {
+          break; // handler says to exit loop 
+        }
+      }
+      // copy the set first: a handler may add or remove extra fds
+      int readyFds[MaxExtraFds];
+      int numReady = 0;
+      for (int i = 0; i < numExtraFds; i++) {
+        if (FD_ISSET(extraFds[i].fd, &rfds)) {
+          readyFds[numReady++] = extraFds[i].fd;
         }
       }
+      bool done = false;
+      for (int i = 0; i < numReady && !done; i++) {
+        done = handleExtraFd(arg, readyFds[i]);
+      }
+      if (done) {
+        break; // handler says to exit loop 
+      }
     }
   }
   return true;
@@ -407,6 +818,15 @@ message_done(void)
     close(ourSocket);
     ourSocket = 0;
   }
+  if (epollFd >= 0) {
+    close(epollFd);
+    epollFd = -1;
+  }
+  numExtraFds = 0;
+#ifdef MESSAGE_MMSG
+  free(recvBufs);
+  recvBufs = NULL;
+#endif
   log_v("message_done: message module closing down.");
 }
 
@@ -50,6 +50,15 @@ typedef struct sockaddr_in addr_t;
 // https://en.wikipedia.org/wiki/User_Datagram_Protocol
 static const int message_MaxBytes = 65507;
 
+// Most datagrams sent or received with one system call; see message_sendBatch
+#define message_BatchSize 32
+
+// Ways message_loop can wait for input; see message_initWith
+typedef enum {
+  message_SELECT,   // select(), rebuilding the fd set every time around
+  message_EPOLL     // Linux epoll; falls back to select elsewhere
+} message_backend_t;
+
 /****************** global functions *********************/
 
 /******************************************/
@@ -64,6 +73,21 @@ static const int message_MaxBytes = 65507;
  */
 int message_init(FILE* logFP);
 
+/******************************************/
+/* message_initWith: initialize the module, choosing the event backend.
+ * Caller provides:
+ *   file pointer(fp), passed through to log_init().  May be NULL.
+ *   the backend message_loop should use to wait for input.
+ * Function returns:
+ *   port number where messages can be sent; zero on error.
+ * Notes:
+ *   message_init(fp) is message_initWith(fp, message_SELECT).
+ *   With message_EPOLL, message_loop uses one epoll set that lives until
+ *   message_done, instead of calling select() with a new fd set each time.
+ * Logs: as message_init.
+ */
+int message_initWith(FILE* logFP, const message_backend_t backend);
+
 /******************************************/
 /* message_noAddr: return an addr_t representing "no address".
  * Logs: nothing.
@@ -90,6 +114,29 @@ bool message_isAddr(const addr_t addr);
  */
 bool message_eqAddr(const addr_t a, const addr_t b);
 
+/******************************************/
+/* message_hashAddr: hash an address
+ * Caller provides: an address
+ * Function returns: a hash of the address; equal addresses
+ *   (by message_eqAddr) have equal hashes.
+ * Logs: nothing.
+ * Notes:
+ *   Lets a module keep a table keyed by address without knowing
+ *   what is inside addr_t.
+ */
+unsigned long message_hashAddr(const addr_t addr);
+
+/******************************************/
+/* message_isLocal: is an address on this machine?
+ * Caller provides: an address
+ * Function returns: true iff it is a loopback address (127.x.x.x).
+ * Logs: nothing.
+ * Notes:
+ *   Lets a program answer some messages, such as admin queries,
+ *   only from its own machine.
+ */
+bool message_isLocal(const addr_t addr);
+
 /******************************************/
 /* message_setAddr: initialize an address to a given hostname and port.
  * Caller provides: 
@@ -115,6 +162,7 @@ bool message_setAddr(const char* hostname, const char* portStr, addr_t* addr);
  * Returns:
  *   a string representation of the address,
  *   which is a pointer to static storage that cannot be retained!
+ *   Each thread has its own, so threads may call this at the same time.
  * Logs:
  *   nothing.
  */
@@ -133,6 +181,48 @@ const char* message_stringAddr(const addr_t addr);
  */
 void message_send(const addr_t to, const char* message);
 
+/******************************************/
+/* message_sendBatch: send several messages at once.
+ * Caller provides:
+ *   an array of 'count' addresses,
+ *   an array of 'count' strings; messages[i] is sent to to[i].
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   Same effect as calling message_send on each pair in order, but on
+ *   Linux the datagrams go out with a single sendmmsg() call per
+ *   message_BatchSize messages.
+ * Logs:
+ *   errors in arguments,
+ *   errors in sending each message.
+ */
+void message_sendBatch(const addr_t to[], const char* messages[], const int count);
+
+/******************************************/
+/* message_addFd: watch another file descriptor in message_loop.
+ * Caller provides:
+ *   an open file descriptor, e.g., a timerfd, signalfd, or another socket,
+ *   a function to call when it is ready to read.
+ * Function returns:
+ *   true if the fd was added; false if error, or too many fds.
+ * Handler:
+ *   handleFd is given message_loop's 'arg' and the fd. It must read from
+ *   the fd (or remove it) so it does not stay ready, and returns true to
+ *   terminate looping, false to keep looping.
+ * Assumptions: message_init() has already been called.
+ * Logs: errors in arguments, errors in adding the fd.
+ */
+bool message_addFd(const int fd, bool (*handleFd)(void* arg, int fd));
+
+/******************************************/
+/* message_removeFd: stop watching a file descriptor.
+ * Caller provides: a file descriptor given earlier to message_addFd.
+ * Function returns: true if it was being watched.
+ * Notes: does not close the fd.
+ * Logs: fds that were not being watched.
+ */
+bool message_removeFd(const int fd);
+
 /******************************************/
 /* message_loop: loop, handling input and incoming messages.
  * Caller provides:
@@ -146,6 +236,7 @@ void message_send(const addr_t to, const char* message);
  *   false, when fatal errors indicate we cannot keep looping.
  * Handlers:
  *   handleTimeout: called when time passes without input or message.
+ *     (fds added with message_addFd have their own handlers.)
  *   handleInput: should read once from stdin and process it.
  *   handleMessage: provided the address from which the message arrived,
  *     and a string containing the contents of the message. The handler should
@@ -158,6 +249,10 @@ void message_send(const addr_t to, const char* message);
  *   errors in arguments,
  *   errors in monitoring stdin and/or network,
  *   sender's address and content of every message received.
+ * Notes:
+ *   On Linux, each time the socket is ready the loop reads up to
+ *   message_BatchSize waiting messages with one recvmmsg() call, and
+ *   calls handleMessage on each in the order they arrived.
  */
 bool message_loop(void* arg, const float timeout,
                   bool (*handleTimeout)(void* arg),
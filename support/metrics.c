@@ -0,0 +1,244 @@
+/*
+ * CS50 Nuggets Project
+ * Team 17 - CecsC
+ *
+ * metrics.c - CS50 'metrics' module
+ * The metrics module counts messages and bytes, and times the phases of
+ * handling them, in one slot per thread; readers add the slots up.
+ *
+ * see metrics.h for more information.
+ *
+ * CecsC 2023
+ */
+
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "metrics.h"
+
+/**************** file-local types ****************/
+/* One thread's counts. Only that thread writes them, so it needs no
+ * read-modify-write; they are atomic only so other threads can read them.
+ */
+typedef struct slot {
+  atomic_uint_fast64_t phaseCount[METRICS_PHASES];
+  atomic_uint_fast64_t phaseNs[METRICS_PHASES];
+  atomic_uint_fast64_t phaseHist[METRICS_PHASES][METRICS_BUCKETS];
+  atomic_uint_fast64_t received[METRICS_TYPES];
+  atomic_uint_fast64_t messagesSent;
+  atomic_uint_fast64_t bytesSent;
+} slot_t;
+
+/**************** file-local global variables ****************/
+static slot_t slots[METRICS_MAX_THREADS];
+static atomic_int numSlots = 0;           // slots claimed so far
+static _Thread_local slot_t* mySlot;      // this thread's slot, once claimed
+static _Thread_local bool noSlot;         // every slot was taken before this thread came
+static uint64_t startNs;                  // when metrics_init was called
+
+static const char* phaseNames[METRICS_PHASES] = {
+  "parse", "key", "visibility", "render", "send"
+};
+static const char* typeNames[METRICS_TYPES] = {
+  "PLAY", "SPECTATE", "KEY", "DELTA", "RESYNC", "RLE", "STATS", "malformed"
+};
+
+/**************** local functions ****************/
+static slot_t* thisSlot(void);
+static void add(atomic_uint_fast64_t* counter, uint64_t n);
+static int bucket(uint64_t ns);
+static double percentile(const uint64_t* hist, uint64_t count, double fraction);
+
+/**************** metrics_init ****************/
+/* see metrics.h for description */
+void
+metrics_init(void)
+{
+  startNs = metrics_start();
+}
+
+/**************** metrics_start ****************/
+/* see metrics.h for description */
+uint64_t
+metrics_start(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**************** metrics_phase ****************/
+/* see metrics.h for description */
+void
+metrics_phase(metrics_phase_t phase, uint64_t start)
+{
+  slot_t* slot = thisSlot();
+  if (slot == NULL || phase < 0 || phase >= METRICS_PHASES) {
+    return;
+  }
+  uint64_t ns = metrics_start() - start;
+  add(&slot->phaseCount[phase], 1);
+  add(&slot->phaseNs[phase], ns);
+  add(&slot->phaseHist[phase][bucket(ns)], 1);
+}
+
+/**************** metrics_received ****************/
+/* see metrics.h for description */
+void
+metrics_received(metrics_type_t type)
+{
+  slot_t* slot = thisSlot();
+  if (slot != NULL && type >= 0 && type < METRICS_TYPES) {
+    add(&slot->received[type], 1);
+  }
+}
+
+/**************** metrics_sent ****************/
+/* see metrics.h for description */
+void
+metrics_sent(int messages, long bytes)
+{
+  slot_t* slot = thisSlot();
+  if (slot != NULL) {
+    add(&slot->messagesSent, messages);
+    add(&slot->bytesSent, bytes);
+  }
+}
+
+/**************** metrics_read ****************/
+/* see metrics.h for description */
+void
+metrics_read(metrics_t* totals)
+{
+  memset(totals, 0, sizeof(metrics_t));
+  totals->seconds = (metrics_start() - startNs) / 1e9;
+
+  int count = atomic_load(&numSlots);
+  for (int s = 0; s < count && s < METRICS_MAX_THREADS; s++) {
+    slot_t* slot = &slots[s];
+    for (int p = 0; p < METRICS_PHASES; p++) {
+      totals->phaseCount[p] += atomic_load_explicit(&slot->phaseCount[p], memory_order_relaxed);
+      totals->phaseNs[p] += atomic_load_explicit(&slot->phaseNs[p], memory_order_relaxed);
+      for (int b = 0; b < METRICS_BUCKETS; b++) {
+        totals->phaseHist[p][b] += atomic_load_explicit(&slot->phaseHist[p][b], memory_order_relaxed);
+      }
+    }
+    for (int t = 0; t < METRICS_TYPES; t++) {
+      totals->received[t] += atomic_load_explicit(&slot->received[t], memory_order_relaxed);
+    }
+    totals->messagesSent += atomic_load_explicit(&slot->messagesSent, memory_order_relaxed);
+    totals->bytesSent += atomic_load_explicit(&slot->bytesSent, memory_order_relaxed);
+  }
+}
+
+/**************** metrics_format ****************/
+/* see metrics.h for description */
+int
+metrics_format(const metrics_t* now, const metrics_t* since, const char* separator,
+               char* buf, size_t size)
+{
+  metrics_t zero;
+  if (since == NULL) {
+    memset(&zero, 0, sizeof(zero));
+    since = &zero;
+  }
+
+  // appends to buf, never past its end; len counts what would have been written
+  size_t len = 0;
+#define APPEND(...) \
+  len += snprintf(buf + (len < size ? len : size), len < size ? size - len : 0, __VA_ARGS__)
+
+  APPEND("uptime=%.1f interval=%.1f", now->seconds, now->seconds - since->seconds);
+
+  APPEND("%sreceived", separator);
+  for (int t = 0; t < METRICS_TYPES; t++) {
+    APPEND(" %s=%llu", typeNames[t], (unsigned long long) (now->received[t] - since->received[t]));
+  }
+
+  APPEND("%ssent messages=%llu bytes=%llu", separator,
+         (unsigned long long) (now->messagesSent - since->messagesSent),
+         (unsigned long long) (now->bytesSent - since->bytesSent));
+
+  for (int p = 0; p < METRICS_PHASES; p++) {
+    uint64_t count = now->phaseCount[p] - since->phaseCount[p];
+    uint64_t ns = now->phaseNs[p] - since->phaseNs[p];
+    uint64_t hist[METRICS_BUCKETS];
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+      hist[b] = now->phaseHist[p][b] - since->phaseHist[p][b];
+    }
+    APPEND("%s%s count=%llu mean_us=%.2f p50_us=%.2f p99_us=%.2f", separator, phaseNames[p],
+           (unsigned long long) count, count > 0 ? ns / 1e3 / count : 0,
+           percentile(hist, count, 0.50), percentile(hist, count, 0.99));
+  }
+#undef APPEND
+
+  return (len < size) ? (int) len : (int) size - 1;
+}
+
+/**************** thisSlot ****************/
+/* Returns the calling thread's slot, claiming one the first time,
+ * or NULL if there are none left.
+ */
+static slot_t*
+thisSlot(void)
+{
+  if (mySlot == NULL && !noSlot) {
+    int s = atomic_fetch_add(&numSlots, 1);
+    if (s < METRICS_MAX_THREADS) {
+      mySlot = &slots[s];
+    } else {
+      noSlot = true;
+    }
+  }
+  return mySlot;
+}
+
+/**************** add ****************/
+/* Adds n to a counter of this thread's slot; no other thread writes it.
+ */
+static void
+add(atomic_uint_fast64_t* counter, uint64_t n)
+{
+  uint64_t value = atomic_load_explicit(counter, memory_order_relaxed);
+  atomic_store_explicit(counter, value + n, memory_order_relaxed);
+}
+
+/**************** bucket ****************/
+/* Returns the histogram bucket for a time of 'ns' nanoseconds.
+ */
+static int
+bucket(uint64_t ns)
+{
+  int b = 0;
+  while (ns > 1 && b < METRICS_BUCKETS - 1) {
+    ns >>= 1;
+    b++;
+  }
+  return b;
+}
+
+/**************** percentile ****************/
+/* Returns, in microseconds, the upper end of the bucket holding the given
+ * fraction of 'count' times, or 0 if there are none.
+ */
+static double
+percentile(const uint64_t* hist, uint64_t count, double fraction)
+{
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t) (fraction * count);
+  uint64_t seen = 0;
+  for (int b = 0; b < METRICS_BUCKETS; b++) {
+    seen += hist[b];
+    if (seen > rank) {
+      return (double) ((uint64_t) 2 << b) / 1e3;
+    }
+  }
+  return (double) ((uint64_t) 2 << (METRICS_BUCKETS - 1)) / 1e3;
+}
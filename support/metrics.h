@@ -0,0 +1,119 @@
+/*
+* Team 17 - CecsC
+* Nuggets Final Project
+* COSC 50, 23S
+*
+* metrics.h - header file for metrics.c
+*
+* metrics module counts what the server does and how long it takes: the
+* time spent in each phase of handling messages, the messages received by
+* type, and the messages and bytes sent. Unlike trace points, metrics are
+* always on; recording one costs a clock read and a few additions.
+*
+* Each thread records into its own slot, so recording takes no lock; any
+* thread may read the totals of all slots with metrics_read. Phase times go
+* into a histogram of power-of-two buckets, so percentiles can be given for
+* any interval between two reads.
+*/
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* phases of handling messages and sending frames */
+typedef enum {
+  METRICS_PARSE,        // reading a message and routing it to its game
+  METRICS_KEY,          // applying a keystroke: handleKey, moveOnMap, sprint
+  METRICS_VISIBILITY,   // updating the mover's visibility after a keystroke
+  METRICS_RENDER,       // drawing and encoding frames: updatePlayers, updateSpectator
+  METRICS_SEND,         // sending the frames drawn: flushOutbox
+  METRICS_PHASES
+} metrics_phase_t;
+
+/* types of message received */
+typedef enum {
+  METRICS_PLAY,
+  METRICS_SPECTATE,
+  METRICS_KEYSTROKE,
+  METRICS_DELTA,
+  METRICS_RESYNC,
+  METRICS_RLE,
+  METRICS_STATS,
+  METRICS_MALFORMED,
+  METRICS_TYPES
+} metrics_type_t;
+
+/* bucket b of a phase histogram counts times from 2^b up to 2^(b+1) ns;
+ * the last also counts anything longer */
+#define METRICS_BUCKETS 36
+
+/* most threads that can record; those beyond record nothing */
+#define METRICS_MAX_THREADS 64
+
+/* totals of every slot, as read by metrics_read */
+typedef struct metrics {
+  double seconds;                                   // since metrics_init
+  uint64_t phaseCount[METRICS_PHASES];
+  uint64_t phaseNs[METRICS_PHASES];
+  uint64_t phaseHist[METRICS_PHASES][METRICS_BUCKETS];
+  uint64_t received[METRICS_TYPES];
+  uint64_t messagesSent;
+  uint64_t bytesSent;
+} metrics_t;
+
+/******** metrics_init **************
+ * starts the clock that metrics_read's 'seconds' counts from
+ * notes:
+ *     call once, before starting any threads
+ */
+void metrics_init(void);
+
+/******** metrics_start **************
+ * output: the time now, in ns, to pass to metrics_phase when the phase ends
+ */
+uint64_t metrics_start(void);
+
+/******** metrics_phase **************
+ * records one run of 'phase', which began at 'start' (from metrics_start)
+ * and ends now
+ */
+void metrics_phase(metrics_phase_t phase, uint64_t start);
+
+/******** metrics_received **************
+ * counts one message received, of the given type
+ */
+void metrics_received(metrics_type_t type);
+
+/******** metrics_sent **************
+ * counts 'messages' messages sent, 'bytes' bytes in all
+ */
+void metrics_sent(int messages, long bytes);
+
+/******** metrics_read **************
+ * fills in 'totals' with the sum of every thread's slot
+ * notes:
+ *     a slot being written as it is read may be a few counts behind
+ */
+void metrics_read(metrics_t* totals);
+
+/******** metrics_format **************
+ * writes what happened between 'since' and 'now', two results of
+ * metrics_read ('since' NULL for everything since metrics_init), into buf:
+ *
+ *   uptime=<secs> interval=<secs>
+ *   received PLAY=<n> SPECTATE=<n> KEY=<n> DELTA=<n> RESYNC=<n> RLE=<n> STATS=<n> malformed=<n>
+ *   sent messages=<n> bytes=<n>
+ *   <phase> count=<n> mean_us=<us> p50_us=<us> p99_us=<us>
+ *   ...
+ *
+ * with the sections separated by 'separator', e.g. "\n" or " | ".
+ * Percentiles are the upper end of their histogram bucket.
+ * output: the length written, at most size - 1, as with snprintf
+ */
+int metrics_format(const metrics_t* now, const metrics_t* since, const char* separator,
+                   char* buf, size_t size);
+
+#endif // __METRICS_H
@@ -0,0 +1,68 @@
+/*
+ * CS50 Nuggets Project
+ * Team 17 - CecsC
+ *
+ * trace.c - CS50 'trace' module
+ * The trace module writes debugging events to a sink chosen at runtime.
+ * Trace points themselves are TRACE macros, compiled out unless
+ * TRACE_LEVEL says otherwise.
+ *
+ * see trace.h for more information.
+ *
+ * CecsC 2023
+ */
+
+#define _POSIX_C_SOURCE 200809L   // clock_gettime, flockfile
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include "trace.h"
+
+/**************** file-local global variables ****************/
+static FILE* traceFP = NULL;        // where events go; NULL for nowhere
+static int traceLevel = TRACE_NONE; // highest level written
+static struct timespec traceStart;  // when trace_init was called
+
+/**************** trace_init ****************/
+/* see trace.h for description */
+void
+trace_init(FILE* fp, int level)
+{
+  traceFP = fp;
+  traceLevel = (fp == NULL) ? TRACE_NONE : level;
+  clock_gettime(CLOCK_MONOTONIC, &traceStart);
+}
+
+/**************** trace_enabled ****************/
+/* see trace.h for description */
+bool
+trace_enabled(int level)
+{
+  return level <= traceLevel;
+}
+
+/**************** trace_event ****************/
+/* see trace.h for description */
+void
+trace_event(const char* module, const char* event, const char* format, ...)
+{
+  if (traceFP == NULL) {
+    return;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double seconds = (now.tv_sec - traceStart.tv_sec) + (now.tv_nsec - traceStart.tv_nsec) / 1e9;
+
+  // one line per event, even with several threads tracing
+  flockfile(traceFP);
+  fprintf(traceFP, "%.6f %s %s ", seconds, module, event);
+  va_list args;
+  va_start(args, format);
+  vfprintf(traceFP, format, args);
+  va_end(args);
+  fputc('\n', traceFP);
+  fflush(traceFP);
+  funlockfile(traceFP);
+}
@@ -0,0 +1,72 @@
+/*
+* Team 17 - CecsC
+* Nuggets Final Project
+* COSC 50, 23S
+*
+* trace.h - header file for trace.c
+*
+* trace module lets the server and the player modules report what they are
+* doing, for debugging, without slowing down a normal build. Each trace point
+* is a TRACE(level, module, event, format, ...) macro:
+*
+*   TRACE(TRACE_MSG, "server", "recv", "from=%s msg='%s'", addr, message);
+*
+* A trace point above TRACE_LEVEL, which is set when compiling, is compiled
+* out entirely; the default TRACE_LEVEL is TRACE_NONE, so by default every
+* trace point is. Build with, e.g., `make TRACE_LEVEL=3` to compile them in.
+* Those compiled in write nothing until trace_init picks a sink and a level
+* at runtime. Each event is one line:
+*
+*   <seconds since trace_init> <module> <event> <text>
+*/
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* trace levels, each including the ones before it */
+#define TRACE_NONE  0     // no tracing
+#define TRACE_INFO  1     // once-a-game events: maps loaded, players joining
+#define TRACE_MSG   2     // every message received
+#define TRACE_FRAME 3     // every frame drawn, cell by cell
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_NONE
+#endif
+
+/* TRACE(level, module, event, format, ...): writes one event to the trace
+ * sink, if 'level' is compiled in and selected at runtime. The arguments are
+ * not evaluated otherwise.
+ */
+#define TRACE(level, module, event, ...)                                \
+  do {                                                                  \
+    if ((level) <= TRACE_LEVEL && trace_enabled(level)) {               \
+      trace_event((module), (event), __VA_ARGS__);                      \
+    }                                                                   \
+  } while (0)
+
+/******** trace_init **************
+ * picks where trace events go, and which
+ * inputs:
+ *     fp - file open for writing, e.g. stderr; NULL turns tracing off
+ *     level - the highest level to write; those above TRACE_LEVEL are
+ *             compiled out, whatever this says
+ * notes:
+ *     call once, before starting any threads; the caller closes fp
+ */
+void trace_init(FILE* fp, int level);
+
+/******** trace_enabled **************
+ * output: true if events at 'level' are written
+ */
+bool trace_enabled(int level);
+
+/******** trace_event **************
+ * writes one event line; use TRACE rather than calling this.
+ * Safe to call from several threads: lines are never interleaved.
+ */
+void trace_event(const char* module, const char* event, const char* format, ...);
+
+#endif // __TRACE_H